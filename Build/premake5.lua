@@ -163,6 +163,13 @@ workspace "Console_Utilities"                  -- Solution Name
     
     -- OS-specific Libraries - Dynamic libs will need to be copied to output
 
+    filter { "system:linux" }
+      links
+      {
+        "pthread",               -- Worker threads for parallel canvas updates
+      }
+    filter {} -- clear filter
+
     --[[
     filter { "system:windows" }  -- Currently all static libs; No copying
       links
@@ -217,3 +224,55 @@ filter{"configurations:Lib", "system:not windows"}
 
 filter {} -- clear filter
 
+
+
+  -------------------------------
+  -- [ BENCHMARK PROJECT ]     --
+  -------------------------------
+  -- Standalone timing programs, one per file. Not part of the library or the demo.
+  project "Benchmarks"
+    kind "ConsoleApp"
+    targetname "benchmarks"
+    targetdir(output_dir_root .. "benchmarks/")
+
+    files
+    {
+      source_dir_root .. "Benchmarks/**.cpp",
+    }
+
+    includedirs
+    {
+      source_dir_engine,
+      source_dir_includes
+    }
+
+    filter { "system:linux" }
+      links { "pthread" }
+    filter {} -- clear filter
+
+
+  -------------------------------
+  -- [ TOOLS PROJECTS ]        --
+  -------------------------------
+  -- Attaches to a canvas streamed over a Unix domain socket. POSIX only.
+  project "StreamViewer"
+    kind "ConsoleApp"
+    targetname "stream_viewer"
+    targetdir(output_dir_root .. "tools/")
+
+    files
+    {
+      source_dir_root .. "Tools/StreamViewer.cpp",
+    }
+
+    includedirs
+    {
+      source_dir_engine,
+      source_dir_includes
+    }
+
+    filter { "system:windows" }
+      kind "None"
+    filter { "system:linux" }
+      links { "pthread" }
+    filter {} -- clear filter
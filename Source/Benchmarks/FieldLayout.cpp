@@ -0,0 +1,145 @@
+// Compares the row-major Field2D against TiledField2D on a sprite workload: a pile of small
+// sprites stamped around a large field every frame, followed by a pass that copies the frame
+// out the way Canvas::Update reads its raster. Each layout is timed twice, once copying the
+// whole frame and once copying only what the sprites touched (rows for the linear layout, tiles
+// for the tiled one), so each copy is compared against the same amount of work in the other.
+#include <stdio.h>
+#include <chrono>
+#include <cstdlib>
+#include "Canvas.hpp"
+
+namespace
+{
+  // Workload size
+  const unsigned int FIELD_WIDTH = 320;
+  const unsigned int FIELD_HEIGHT = 120;
+  const unsigned int SPRITE_WIDTH = 8;
+  const unsigned int SPRITE_HEIGHT = 6;
+  const unsigned int SPRITE_COUNT = 24;
+  const unsigned int FRAMES = 2000;
+
+  // Where a sprite lands on a given frame. Same sequence for every layout.
+  struct Sprite
+  {
+    unsigned int X;
+    unsigned int Y;
+    int DX;
+    int DY;
+  };
+
+  void stepSprites(Sprite *sprites)
+  {
+    for (unsigned int i = 0; i < SPRITE_COUNT; ++i)
+    {
+      Sprite &s = sprites[i];
+      if (s.X + s.DX > FIELD_WIDTH - SPRITE_WIDTH) s.DX = -s.DX;
+      if (s.Y + s.DY > FIELD_HEIGHT - SPRITE_HEIGHT) s.DY = -s.DY;
+      s.X += s.DX;
+      s.Y += s.DY;
+    }
+  }
+
+  void resetSprites(Sprite *sprites)
+  {
+    srand(0);
+    for (unsigned int i = 0; i < SPRITE_COUNT; ++i)
+    {
+      sprites[i].X = rand() % (FIELD_WIDTH - SPRITE_WIDTH);
+      sprites[i].Y = rand() % (FIELD_HEIGHT - SPRITE_HEIGHT);
+      sprites[i].DX = rand() % 2 ? 1 : -1;
+      sprites[i].DY = rand() % 2 ? 1 : -1;
+    }
+  }
+
+  // Microseconds since some point, for timing.
+  long long nowMicroseconds()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Stamp sprites cell by cell in row-major layout, then copy out every row, or only the rows
+  // the sprites touched when dirtyOnly is set.
+  long long benchLinear(bool dirtyOnly, unsigned long &checksum)
+  {
+    RConsole::Field2D<RConsole::RasterInfo> field(FIELD_WIDTH, FIELD_HEIGHT);
+    RConsole::Field2D<RConsole::RasterInfo> frame(FIELD_WIDTH, FIELD_HEIGHT);
+    bool dirty[FIELD_HEIGHT] = { false };
+    Sprite sprites[SPRITE_COUNT];
+    resetSprites(sprites);
+
+    const long long start = nowMicroseconds();
+    for (unsigned int f = 0; f < FRAMES; ++f)
+    {
+      stepSprites(sprites);
+      for (unsigned int i = 0; i < SPRITE_COUNT; ++i)
+        for (unsigned int y = 0; y < SPRITE_HEIGHT; ++y)
+        {
+          for (unsigned int x = 0; x < SPRITE_WIDTH; ++x)
+            field.Get(sprites[i].X + x, sprites[i].Y + y) = RConsole::RasterInfo('a' + i % 26, RConsole::WHITE);
+          dirty[sprites[i].Y + y] = true;
+        }
+
+      for (unsigned int y = 0; y < FIELD_HEIGHT; ++y)
+      {
+        if (!dirtyOnly || dirty[y])
+          frame.CopyRow(y, field, y);
+        dirty[y] = false;
+      }
+      checksum += frame.Peek(sprites[0].X, sprites[0].Y).Value;
+    }
+
+    return nowMicroseconds() - start;
+  }
+
+  // Same workload in tiled layout, copying out every tile, or only the tiles the sprites touched
+  // when dirtyOnly is set.
+  long long benchTiled(bool dirtyOnly, unsigned long &checksum)
+  {
+    RConsole::TiledField2D<RConsole::RasterInfo> field(FIELD_WIDTH, FIELD_HEIGHT);
+    RConsole::Field2D<RConsole::RasterInfo> frame(FIELD_WIDTH, FIELD_HEIGHT);
+    Sprite sprites[SPRITE_COUNT];
+    resetSprites(sprites);
+
+    const long long start = nowMicroseconds();
+    for (unsigned int f = 0; f < FRAMES; ++f)
+    {
+      stepSprites(sprites);
+      for (unsigned int i = 0; i < SPRITE_COUNT; ++i)
+        for (unsigned int y = 0; y < SPRITE_HEIGHT; ++y)
+          for (unsigned int x = 0; x < SPRITE_WIDTH; ++x)
+            field.Get(sprites[i].X + x, sprites[i].Y + y) = RConsole::RasterInfo('a' + i % 26, RConsole::WHITE);
+
+      if (dirtyOnly)
+        field.CopyDirtyTo(frame);
+      else
+        field.CopyTo(frame);
+      field.ClearDirty();
+      checksum += frame.Peek(sprites[0].X, sprites[0].Y).Value;
+    }
+
+    return nowMicroseconds() - start;
+  }
+}
+
+
+// Run each layout and copy and report time per frame.
+int main(int, char**)
+{
+  unsigned long sums[4] = { 0, 0, 0, 0 };
+  const long long linearFull = benchLinear(false, sums[0]);
+  const long long tiledFull = benchTiled(false, sums[1]);
+  const long long linearDirty = benchLinear(true, sums[2]);
+  const long long tiledDirty = benchTiled(true, sums[3]);
+  const bool match = sums[0] == sums[1] && sums[0] == sums[2] && sums[0] == sums[3];
+
+  printf("Sprite workload: %ux%u field, %u sprites of %ux%u, %u frames\n",
+    FIELD_WIDTH, FIELD_HEIGHT, SPRITE_COUNT, SPRITE_WIDTH, SPRITE_HEIGHT, FRAMES);
+  printf("  full copy:  linear Field2D      %8.2f us/frame\n", static_cast<double>(linearFull) / FRAMES);
+  printf("              tiled  TiledField2D %8.2f us/frame\n", static_cast<double>(tiledFull) / FRAMES);
+  printf("  dirty copy: linear rows         %8.2f us/frame\n", static_cast<double>(linearDirty) / FRAMES);
+  printf("              tiled  tiles        %8.2f us/frame\n", static_cast<double>(tiledDirty) / FRAMES);
+  printf("  checksums %s\n", match ? "match" : "DIFFER");
+
+  return match ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+#pragma once
+#ifndef ART_HPP
+#define ART_HPP
+
+// Includes
+#include <memory>           // Shared snapshots
+#include <unordered_map>    // Art by name
+#include "Snapshot.hpp"
+
+
+// ASCII art, parsed once into cells and kept by name. Art is drawn with a bulk blit, so static
+// logos and frames cost a copy of their cells per frame instead of decoding their text again.
+namespace RConsole
+{
+  // Named pieces of ASCII art ready to blit. Text art can be plain or colored with ANSI escapes,
+  // and its background glyph (a space by default) is stored as empty cells, which blits skip.
+  // Large art, or packs of it, can be saved as snapshots and mapped back in, either whole or as
+  // named regions of one big sheet.
+  //
+  // Views handed out stay good until that art is replaced or removed. Mapped art keeps its file
+  // mapped for as long as anything cached is cut from it.
+  class ArtCache
+  {
+  public:
+    // Constructor
+    ArtCache();
+
+    // Loading. Each returns the art's cells, or an empty view if it couldn't be loaded.
+    Field2DView<const RasterInfo> Parse(const std::string &name, const char *text, size_t len, Color color = WHITE, Glyph background = ' ');
+    Field2DView<const RasterInfo> Load(const std::string &name, const char *path, Color color = WHITE, Glyph background = ' ');
+    Field2DView<const RasterInfo> Map(const std::string &name, const char *path);
+    Field2DView<const RasterInfo> Cut(const std::string &name, const std::string &sheet, unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    bool Save(const std::string &name, const char *path) const;
+
+    // Lookup
+    Field2DView<const RasterInfo> Get(const std::string &name) const;
+    bool Has(const std::string &name) const;
+    size_t Count() const;
+    void Remove(const std::string &name);
+    void Clear();
+
+    // Drawing
+    bool Draw(Canvas &canvas, const std::string &name, int x, int y) const;
+
+    // Static member functions
+    static void ParseArt(Field2D<RasterInfo> &out, const char *text, size_t len, Color color = WHITE, Glyph background = ' ');
+
+  private:
+    // Art parsed into cells of its own, or a view of a mapped snapshot.
+    struct Entry
+    {
+      Entry() : Cells(0, 0), View() {  }
+      Field2D<RasterInfo> Cells;
+      std::shared_ptr<Snapshot> Mapped;
+      Field2DView<const RasterInfo> View;
+    };
+
+    // Private methods.
+    static void parseArt(Field2D<RasterInfo> *out, unsigned int &width, unsigned int &height, const char *text, size_t len, Color color, Glyph background);
+    static size_t parseEscape(const char *text, size_t len, Color &color, Color base, bool &bold);
+
+    // Variables
+    std::unordered_map<std::string, Entry> art_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  ///////////////
+ // Art cache //
+///////////////
+// Constructor, starts out empty.
+  ArtCache::ArtCache()
+    : art_()
+  {  }
+
+  // Parses text art and caches it as name, replacing anything already called that.
+  Field2DView<const RasterInfo> ArtCache::Parse(const std::string &name, const char *text, size_t len, Color color, Glyph background)
+  {
+    Entry &entry = art_[name];
+    entry.Mapped.reset();
+    ParseArt(entry.Cells, text, len, color, background);
+    entry.View = static_cast<const Field2D<RasterInfo> &>(entry.Cells).View();
+    return entry.View;
+  }
+
+  // Reads and parses the text art at path as name. Art already cached under name is returned as
+  // it is without touching the file, so this can be called wherever the art is needed.
+  Field2DView<const RasterInfo> ArtCache::Load(const std::string &name, const char *path, Color color, Glyph background)
+  {
+    auto found = art_.find(name);
+    if (found != art_.end())
+      return found->second.View;
+
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+      return Field2DView<const RasterInfo>();
+
+    std::string contents;
+    char chunk[65536];
+    size_t got = 0;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+      contents.append(chunk, got);
+    fclose(file);
+
+    return Parse(name, contents.data(), contents.size(), color, background);
+  }
+
+  // Maps the snapshot at path as name. The cells are used straight from the file, so this costs
+  // the same however big it is. Like Load, art already cached under name is returned as it is.
+  Field2DView<const RasterInfo> ArtCache::Map(const std::string &name, const char *path)
+  {
+    auto found = art_.find(name);
+    if (found != art_.end())
+      return found->second.View;
+
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    if (!snapshot->Open(path))
+      return Field2DView<const RasterInfo>();
+
+    Entry &entry = art_[name];
+    entry.Mapped = snapshot;
+    entry.View = snapshot->Cells();
+    return entry.View;
+  }
+
+  // Caches a rectangle of other art as name, without copying it. This is how a pack of art saved
+  // as one sheet is split back up once mapped. The rectangle is clipped to the sheet.
+  Field2DView<const RasterInfo> ArtCache::Cut(const std::string &name, const std::string &sheet, unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+  {
+    auto found = art_.find(sheet);
+    if (found == art_.end())
+      return Field2DView<const RasterInfo>();
+
+    // Cutting from parsed art copies it, since the sheet could be replaced later.
+    const Entry &from = found->second;
+    Entry cut;
+    if (from.Mapped)
+    {
+      cut.Mapped = from.Mapped;
+      cut.View = from.View.SubView(x, y, w, h);
+    }
+    else
+    {
+      const Field2DView<const RasterInfo> source = from.View.SubView(x, y, w, h);
+      cut.Cells.Resize(source.Width(), source.Height());
+      for (unsigned int row = 0; row < source.Height(); ++row)
+        std::copy(source.RowData(row), source.RowData(row) + source.Width(), cut.Cells.Row(row));
+    }
+
+    Entry &entry = art_[name];
+    entry.Cells = std::move(cut.Cells);
+    entry.Mapped = cut.Mapped;
+    entry.View = cut.Mapped ? cut.View : static_cast<const Field2D<RasterInfo> &>(entry.Cells).View();
+    return entry.View;
+  }
+
+  // Saves art as a snapshot to be mapped back in later.
+  bool ArtCache::Save(const std::string &name, const char *path) const
+  {
+    auto found = art_.find(name);
+    if (found == art_.end())
+      return false;
+    return Snapshot::Save(path, found->second.View);
+  }
+
+  // The cells of art, or an empty view if nothing is cached under name.
+  Field2DView<const RasterInfo> ArtCache::Get(const std::string &name) const
+  {
+    auto found = art_.find(name);
+    return (found != art_.end()) ? found->second.View : Field2DView<const RasterInfo>();
+  }
+
+  // Whether anything is cached under name.
+  bool ArtCache::Has(const std::string &name) const
+  {
+    return art_.find(name) != art_.end();
+  }
+
+  // How many pieces of art are cached.
+  size_t ArtCache::Count() const
+  {
+    return art_.size();
+  }
+
+  // Drops art from the cache.
+  void ArtCache::Remove(const std::string &name)
+  {
+    art_.erase(name);
+  }
+
+  // Drops everything.
+  void ArtCache::Clear()
+  {
+    art_.clear();
+  }
+
+  // Blits art onto a canvas with its top left corner at x, y. Returns false if there's no art
+  // called name.
+  bool ArtCache::Draw(Canvas &canvas, const std::string &name, int x, int y) const
+  {
+    auto found = art_.find(name);
+    if (found == art_.end())
+      return false;
+
+    canvas.Blit(found->second.View, x, y);
+    return true;
+  }
+
+  // Parses text art into cells. Lines become rows and the widest line sets the width, with
+  // shorter lines padded out by empty cells, as is the background glyph. SGR escapes set the
+  // color of what follows, with resets going back to color, and any other escapes are skipped.
+  // Tabs move to the next multiple of 8 columns.
+  void ArtCache::ParseArt(Field2D<RasterInfo> &out, const char *text, size_t len, Color color, Glyph background)
+  {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    parseArt(nullptr, width, height, text, len, color, background);
+
+    out.Resize(width, height);
+    out.Fill(RasterInfo(GLYPH_EMPTY, color));
+    parseArt(&out, width, height, text, len, color, background);
+  }
+
+  // Walks text art, writing it into out if there is one, and measuring it either way.
+  void ArtCache::parseArt(Field2D<RasterInfo> *out, unsigned int &width, unsigned int &height, const char *text, size_t len, Color color, Glyph background)
+  {
+    const Color base = color;
+    bool bold = false;
+    unsigned int x = 0;
+    unsigned int y = 0;
+    width = 0;
+    height = 0;
+
+    size_t read = 0;
+    while (read < len)
+    {
+      const char c = text[read];
+      if (c == '\n')
+      {
+        ++read;
+        x = 0;
+        ++y;
+        continue;
+      }
+      if (c == '\r')
+      {
+        ++read;
+        continue;
+      }
+      if (c == '\033')
+      {
+        read += parseEscape(text + read, len - read, color, base, bold);
+        continue;
+      }
+      if (c == '\t')
+      {
+        ++read;
+        x = (x / 8 + 1) * 8;
+        width = std::max(width, x);
+        continue;
+      }
+
+      // Glyphs that take up no cells, such as a NUL, have nowhere to go and are skipped.
+      Glyph glyph = GLYPH_EMPTY;
+      read += DecodeGlyph(text + read, len - read, glyph);
+      const unsigned int cells = GlyphWidth(glyph);
+      if (cells == 0)
+        continue;
+      if (out != nullptr && glyph != background && x + cells <= out->Width() && y < out->Height())
+      {
+        RasterInfo *row = out->Row(y);
+        row[x] = RasterInfo(glyph, color);
+        if (cells == 2)
+          row[x + 1] = RasterInfo(GLYPH_WIDE_TAIL, color);
+      }
+      x += cells;
+      width = std::max(width, x);
+      height = y + 1;
+    }
+  }
+
+  // Reads the escape sequence at text, applying it to color if it's an SGR one. Bold, which
+  // carries over between sequences, and the bright colors pick the light half of the palette.
+  // Resets go back to base exactly as it was given. Returns how many bytes it took up.
+  size_t ArtCache::parseEscape(const char *text, size_t len, Color &color, Color base, bool &bold)
+  {
+    // ANSI color order to palette order.
+    static const int palette[8] = { BLACK, RED, GREEN, BROWN, BLUE, MAGENTA, CYAN, GREY };
+
+    if (len < 2 || text[1] != '[')
+      return (len < 2) ? len : 2;
+
+    // Find the end of the sequence, a byte from @ to ~.
+    size_t end = 2;
+    while (end < len && (text[end] < 0x40 || text[end] > 0x7E))
+      ++end;
+    if (end == len)
+      return len;
+    if (text[end] != 'm')
+      return end + 1;
+
+    // Hue is only set by a color in this sequence. Otherwise the color stays, unless bold changes.
+    int value = static_cast<int>(color);
+    int hue = -1;
+    bool bright = false;
+    bool boldChanged = false;
+    unsigned int parameter = 0;
+    for (size_t i = 2; i <= end; ++i)
+    {
+      if (text[i] >= '0' && text[i] <= '9')
+      {
+        parameter = parameter * 10 + (text[i] - '0');
+        continue;
+      }
+
+      if (parameter == 0 || parameter == 39)
+      {
+        value = static_cast<int>(base);
+        hue = -1;
+        bright = false;
+        if (parameter == 0)
+          bold = false;
+      }
+      else if (parameter == 1 || parameter == 22)
+      {
+        bold = (parameter == 1);
+        boldChanged = true;
+      }
+      else if (parameter >= 30 && parameter <= 37)
+      {
+        hue = palette[parameter - 30];
+        bright = false;
+      }
+      else if (parameter >= 90 && parameter <= 97)
+      {
+        hue = palette[parameter - 90];
+        bright = true;
+      }
+      parameter = 0;
+    }
+
+    if (hue >= 0)
+      value = hue + ((bright || bold) ? 8 : 0);
+    else if (boldChanged && value != static_cast<int>(base) && value >= 0 && value < 16)
+      value = value % 8 + (bold ? 8 : 0);
+    color = static_cast<Color>(value);
+    return end + 1;
+  }
+}
+
+#endif
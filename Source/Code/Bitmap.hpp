@@ -0,0 +1,298 @@
+#pragma once
+#ifndef BITMAP_HPP
+#define BITMAP_HPP
+
+// Includes
+#include <vector>           // Dirty spans per row of cells
+#include <algorithm>        // Span bookkeeping
+#include "Canvas.hpp"
+
+
+// Sub-cell bitmaps. Pixels are packed one bit each into a byte per cell, so turning a cell into
+// its glyph is a single lookup, and setting a run of pixels along a row is an OR across bytes.
+namespace RConsole
+{
+  // How a bitmap splits up its cells.
+  enum BitmapMode
+  {
+    BITMAP_BRAILLE,     // 2x4 pixels per cell, drawn with braille patterns.
+    BITMAP_HALF_BLOCK   // 1x2 pixels per cell, drawn with upper/lower/full blocks.
+  };
+
+  // A surface of on/off pixels at a finer resolution than the canvas, for plots and sparklines.
+  // Cells are only turned back into glyphs when their pixels change, and cells with no pixels
+  // set are transparent when the bitmap is drawn. Each cell takes the color it was last set with.
+  class Bitmap
+  {
+  public:
+    // Constructor
+    Bitmap(unsigned int cellWidth, unsigned int cellHeight, BitmapMode mode = BITMAP_BRAILLE);
+
+    // Structure Info
+    unsigned int Width() const;
+    unsigned int Height() const;
+    unsigned int CellWidth() const;
+    unsigned int CellHeight() const;
+    BitmapMode Mode() const;
+
+    // Pixels, in pixel coordinates. Everything is clipped to the bitmap.
+    void Set(int x, int y, Color color = WHITE);
+    void Unset(int x, int y);
+    bool Get(int x, int y) const;
+    void SetRow(int x, int y, int length, Color color = WHITE);
+    void Line(int x0, int y0, int x1, int y1, Color color = WHITE);
+    void Clear();
+
+    // Drawing
+    void Draw(Canvas &canvas, int x, int y);
+
+  private:
+    // The cells in a row that changed since they were last turned into glyphs.
+    struct DirtySpan
+    {
+      unsigned int Start;
+      unsigned int End;
+    };
+
+    // Private member functions
+    uint8_t pixelBit(unsigned int column, unsigned int row) const;
+    void markDirty(unsigned int cellY, unsigned int start, unsigned int end);
+    void convertRow(unsigned int cellY);
+
+    // Variables
+    BitmapMode mode_;
+    unsigned int pixelsX_;
+    unsigned int pixelsY_;
+    Field2D<uint8_t> bits_;
+    Field2D<RasterInfo> cells_;
+    std::vector<DirtySpan> dirty_;
+    Glyph glyphs_[256];
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  ////////////
+ // Bitmap //
+////////////
+// Constructor, a bitmap covering cellWidth by cellHeight cells with nothing set.
+  Bitmap::Bitmap(unsigned int cellWidth, unsigned int cellHeight, BitmapMode mode)
+    : mode_(mode)
+    , pixelsX_(mode == BITMAP_BRAILLE ? 2 : 1)
+    , pixelsY_(mode == BITMAP_BRAILLE ? 4 : 2)
+    , bits_(cellWidth, cellHeight, static_cast<uint8_t>(0))
+    , cells_(cellWidth, cellHeight, RasterInfo(GLYPH_EMPTY, WHITE))
+    , dirty_(cellHeight)
+  {
+    // Lookup from a cell's bits to its glyph. Braille bits are already in dot order.
+    glyphs_[0] = GLYPH_EMPTY;
+    for (unsigned int bits = 1; bits < 256; ++bits)
+      glyphs_[bits] = (mode == BITMAP_BRAILLE) ? (GLYPH_BRAILLE | bits) : GLYPH_EMPTY;
+    if (mode == BITMAP_HALF_BLOCK)
+    {
+      glyphs_[1] = GLYPH_BLOCK_UPPER;
+      glyphs_[2] = GLYPH_BLOCK_LOWER;
+      glyphs_[3] = GLYPH_BLOCK_FULL;
+    }
+
+    for (unsigned int y = 0; y < cellHeight; ++y)
+      dirty_[y].Start = dirty_[y].End = 0;
+  }
+
+  // Width in pixels.
+  unsigned int Bitmap::Width() const
+  {
+    return bits_.Width() * pixelsX_;
+  }
+
+  // Height in pixels.
+  unsigned int Bitmap::Height() const
+  {
+    return bits_.Height() * pixelsY_;
+  }
+
+  // Width in cells.
+  unsigned int Bitmap::CellWidth() const
+  {
+    return bits_.Width();
+  }
+
+  // Height in cells.
+  unsigned int Bitmap::CellHeight() const
+  {
+    return bits_.Height();
+  }
+
+  // What kind of glyphs the bitmap draws with.
+  BitmapMode Bitmap::Mode() const
+  {
+    return mode_;
+  }
+
+  // Turns on the pixel at x, y.
+  void Bitmap::Set(int x, int y, Color color)
+  {
+    SetRow(x, y, 1, color);
+  }
+
+  // Turns off the pixel at x, y.
+  void Bitmap::Unset(int x, int y)
+  {
+    if (x < 0 || y < 0) return;
+    if (static_cast<unsigned int>(x) >= Width()) return;
+    if (static_cast<unsigned int>(y) >= Height()) return;
+
+    const unsigned int cellX = x / pixelsX_;
+    const unsigned int cellY = y / pixelsY_;
+    bits_.Get(cellX, cellY) &= static_cast<uint8_t>(~pixelBit(x % pixelsX_, y % pixelsY_));
+    markDirty(cellY, cellX, cellX + 1);
+  }
+
+  // Whether the pixel at x, y is on. Anything off the bitmap is off.
+  bool Bitmap::Get(int x, int y) const
+  {
+    if (x < 0 || y < 0) return false;
+    if (static_cast<unsigned int>(x) >= Width()) return false;
+    if (static_cast<unsigned int>(y) >= Height()) return false;
+
+    return (bits_.Peek(x / pixelsX_, y / pixelsY_) & pixelBit(x % pixelsX_, y % pixelsY_)) != 0;
+  }
+
+  // Turns on length pixels along row y starting at x. The cells the run fully covers all get
+  // the same bits ORed in, so the middle of the run is one tight loop over bytes.
+  void Bitmap::SetRow(int x, int y, int length, Color color)
+  {
+    if (length <= 0) return;
+    if (y < 0 || static_cast<unsigned int>(y) >= Height()) return;
+
+    // Clip on both sides.
+    const long long end = std::min(static_cast<long long>(x) + length, static_cast<long long>(Width()));
+    if (x < 0) x = 0;
+    if (x >= end) return;
+
+    const unsigned int cellY = y / pixelsY_;
+    const unsigned int row = y % pixelsY_;
+    const unsigned int first = x / pixelsX_;
+    const unsigned int last = static_cast<unsigned int>(end - 1) / pixelsX_;
+    uint8_t both = pixelBit(0, row);
+    if (pixelsX_ == 2)
+      both |= pixelBit(1, row);
+
+    // A run starting or ending halfway through a braille cell only covers one of its columns.
+    uint8_t firstBits = both;
+    uint8_t lastBits = both;
+    if (pixelsX_ == 2 && x % 2 == 1)
+      firstBits &= static_cast<uint8_t>(~pixelBit(0, row));
+    if (pixelsX_ == 2 && (end - 1) % 2 == 0)
+      lastBits &= static_cast<uint8_t>(~pixelBit(1, row));
+
+    uint8_t *bits = bits_.Row(cellY);
+    if (first == last)
+    {
+      bits[first] |= firstBits & lastBits;
+    }
+    else
+    {
+      bits[first] |= firstBits;
+      for (unsigned int i = first + 1; i < last; ++i)
+        bits[i] |= both;
+      bits[last] |= lastBits;
+    }
+
+    RasterInfo *cells = cells_.Row(cellY);
+    for (unsigned int i = first; i <= last; ++i)
+      cells[i].C = color;
+
+    markDirty(cellY, first, last + 1);
+  }
+
+  // Bresenham line between two pixels, including both ends.
+  void Bitmap::Line(int x0, int y0, int x1, int y1, Color color)
+  {
+    const int dx = std::abs(x1 - x0);
+    const int dy = -std::abs(y1 - y0);
+    const int stepX = (x0 < x1) ? 1 : -1;
+    const int stepY = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+
+    while (true)
+    {
+      Set(x0, y0, color);
+      if (x0 == x1 && y0 == y1)
+        break;
+
+      const int doubled = 2 * error;
+      if (doubled >= dy)
+      {
+        error += dy;
+        x0 += stepX;
+      }
+      if (doubled <= dx)
+      {
+        error += dx;
+        y0 += stepY;
+      }
+    }
+  }
+
+  // Turns every pixel off.
+  void Bitmap::Clear()
+  {
+    bits_.Zero();
+    for (unsigned int y = 0; y < bits_.Height(); ++y)
+      markDirty(y, 0, bits_.Width());
+  }
+
+  // Draws the bitmap onto the canvas with its top left cell at x, y. Cells that changed since
+  // the last draw are turned into glyphs first; cells with nothing set are left transparent.
+  void Bitmap::Draw(Canvas &canvas, int x, int y)
+  {
+    for (unsigned int cellY = 0; cellY < bits_.Height(); ++cellY)
+      convertRow(cellY);
+
+    canvas.Blit(cells_, x, y);
+  }
+
+  // The bit for a pixel within a cell.
+  uint8_t Bitmap::pixelBit(unsigned int column, unsigned int row) const
+  {
+    if (mode_ == BITMAP_BRAILLE)
+      return BrailleDot(column, row);
+    return static_cast<uint8_t>(1 << row);
+  }
+
+  // Grows the dirty span of a row of cells to cover [start, end).
+  void Bitmap::markDirty(unsigned int cellY, unsigned int start, unsigned int end)
+  {
+    DirtySpan &span = dirty_[cellY];
+    if (span.Start == span.End)
+    {
+      span.Start = start;
+      span.End = end;
+      return;
+    }
+
+    span.Start = std::min(span.Start, start);
+    span.End = std::max(span.End, end);
+  }
+
+  // Turns the dirty cells of a row into glyphs.
+  void Bitmap::convertRow(unsigned int cellY)
+  {
+    DirtySpan &span = dirty_[cellY];
+    const uint8_t *bits = bits_.Row(cellY);
+    RasterInfo *cells = cells_.Row(cellY);
+    for (unsigned int i = span.Start; i < span.End; ++i)
+      cells[i].Value = glyphs_[bits[i]];
+
+    span.Start = span.End = 0;
+  }
+}
+
+#endif
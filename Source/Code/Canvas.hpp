@@ -7,14 +7,37 @@
 #include <iostream>         // ostream access
 #include <csignal>          // Signal termination.
 #include <chrono>           // Time related info for sleeping.
-#include <thread>           // Sleep on exit to allow for update to finish.
+#include <thread>           // Worker pool threads.
 #include <string>           // String for parsing, storage, etc
 #include <unordered_map>    // Storing Canvases and other data
 #include <sstream>          // std::stringstream - string manipulation
+#include <cstring>          // memset, memcpy, strlen
+#include <cstdint>          // Fixed width glyph storage
+#include <vector>           // Grapheme pool storage
+#include <mutex>            // Worker pool synchronization
+#include <condition_variable> // Worker pool wakeups
+#include <atomic>           // Worker pool task counter
+#include <functional>       // Worker pool tasks
+#include <type_traits>      // Fast paths for trivially copyable fields
+#include <algorithm>        // Bulk copies for everything else
+#include <memory>           // Allocators for Field2D
+#include <new>              // Raw allocation for aligned storage
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>      // Span drawing
+#define RConsole_HAS_STRING_VIEW
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>      // Scanning rows 16 bytes at a time
+#define RConsole_HAS_SSE2
+#endif
 
 #ifdef _WIN32
 #include <windows.h>  // for WinAPI and Sleep()
 #define _NO_OLDNAMES  // for MinGW compatibility
+#else
+#include <sys/ioctl.h>  // Terminal size
+#include <unistd.h>     // STDOUT_FILENO
+#include <fcntl.h>      // Non-blocking wake pipe
 #endif 
 
 // For strict unused variable warnings.
@@ -49,6 +72,16 @@
 // Console Settings
 #define RConsole_NO_THREADING // Define we aren't threading- printing becomes unsafe, but faster.
 
+// Canvases with at least this many cells diff and encode their rows in parallel bands.
+#ifndef RConsole_PARALLEL_MIN_CELLS
+#define RConsole_PARALLEL_MIN_CELLS 32768
+#endif
+
+// Fewest rows a parallel band will be given, so threads aren't spun up for slivers.
+#ifndef RConsole_PARALLEL_MIN_ROWS
+#define RConsole_PARALLEL_MIN_ROWS 8
+#endif
+
 
 // Definitions and tempates, etc
 namespace RConsole
@@ -295,11 +328,13 @@ namespace RConsole
 #else
 #ifdef TIOCGSIZE
       struct ttysize ts;
-      ioctl(STDIN_FILENO, TIOCGSIZE, &ts);
+      if (ioctl(STDIN_FILENO, TIOCGSIZE, &ts) != 0)
+        return -1;
       return ts.ts_lines;
 #elif defined(TIOCGWINSZ)
       struct winsize ts;
-      ioctl(STDIN_FILENO, TIOCGWINSZ, &ts);
+      if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ts) != 0)
+        return -1;
       return ts.ws_row;
 #else // TIOCGSIZE
       return -1;
@@ -320,11 +355,13 @@ namespace RConsole
 #else
 #ifdef TIOCGSIZE
       struct ttysize ts;
-      ioctl(STDIN_FILENO, TIOCGSIZE, &ts);
+      if (ioctl(STDIN_FILENO, TIOCGSIZE, &ts) != 0)
+        return -1;
       return ts.ts_cols;
 #elif defined(TIOCGWINSZ)
       struct winsize ts;
-      ioctl(STDIN_FILENO, TIOCGWINSZ, &ts);
+      if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ts) != 0)
+        return -1;
       return ts.ws_col;
 #else // TIOCGSIZE
       return -1;
@@ -363,16 +400,199 @@ namespace RConsole
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+  // Row layout for a Field2D. Rows are padded so each one starts on a multiple of Bytes,
+  // as long as the memory itself comes from an allocator with at least that alignment.
+  // Zero means no padding, rows are packed back to back.
+  struct RowAlignment
+  {
+    explicit RowAlignment(unsigned int bytes = 0) : Bytes(bytes) {  }
+    unsigned int Bytes;
+  };
+
+  // Allocator that hands out memory aligned to Alignment bytes, such as a cache line.
+  template <typename T, size_t Alignment = 64>
+  class AlignedAllocator
+  {
+  public:
+    typedef T value_type;
+    template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    // Constructors
+    AlignedAllocator() {  }
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) {  }
+
+    // Allocation
+    T *allocate(size_t count);
+    void deallocate(T *ptr, size_t count);
+    bool operator ==(const AlignedAllocator &) const { return true; }
+    bool operator !=(const AlignedAllocator &) const { return false; }
+  };
+
+  // A bump allocator that many fields can share. Memory is handed out in order from large
+  // blocks and only given back all at once, when the arena is reset or destroyed, so the
+  // arena has to outlive everything allocated from it.
+  class Arena
+  {
+  public:
+    // Constructor
+    explicit Arena(size_t blockSize = 1 << 20);
+    ~Arena();
+
+    // Member Functions
+    void *Allocate(size_t bytes, size_t alignment);
+    void Reset();
+    size_t BytesUsed() const;
+
+  private:
+    // Hidden Constructors
+    Arena(const Arena &rhs);
+    Arena &operator=(const Arena &rhs);
+
+    // A single chunk of memory that allocations are carved out of.
+    struct Block
+    {
+      char *Memory;
+      size_t Size;
+      size_t Used;
+    };
+
+    // Variables
+    std::vector<Block> blocks_;
+    size_t current_;
+    size_t blockSize_;
+  };
+
+  // Allocator that carves memory out of an Arena, aligned to Alignment bytes.
+  template <typename T, size_t Alignment = 64>
+  class ArenaAllocator
+  {
+    // Rebound copies need to see the arena.
+    template <typename U, size_t A> friend class ArenaAllocator;
+
+  public:
+    typedef T value_type;
+    template <typename U> struct rebind { typedef ArenaAllocator<U, Alignment> other; };
+
+    // Constructors
+    explicit ArenaAllocator(Arena &arena) : arena_(&arena) {  }
+    template <typename U> ArenaAllocator(const ArenaAllocator<U, Alignment> &rhs) : arena_(rhs.arena_) {  }
+
+    // Allocation
+    T *allocate(size_t count);
+    void deallocate(T *ptr, size_t count);
+    bool operator ==(const ArenaAllocator &rhs) const { return arena_ == rhs.arena_; }
+    bool operator !=(const ArenaAllocator &rhs) const { return arena_ != rhs.arena_; }
+
+  private:
+    // Variables
+    Arena *arena_;
+  };
+
   // Forward declare Field2D for use later.
-  template <typename T>
+  template <typename T, typename Allocator = std::allocator<T> >
   class Field2D;
 
-  // A proxy class for the [] operator, allowing you to use the [] operator
+  // A rectangle of cells, such as the part of a field that holds anything. Empty when it has
+  // no width or height.
+  struct CellRect
+  {
+    CellRect(unsigned int x = 0, unsigned int y = 0, unsigned int w = 0, unsigned int h = 0) : X(x), Y(y), Width(w), Height(h) {  }
+    bool Empty() const { return Width == 0 || Height == 0; }
+    unsigned int X;
+    unsigned int Y;
+    unsigned int Width;
+    unsigned int Height;
+  };
+
+  // Finding the part of a field that isn't background. Rows are scanned in memory order, 16
+  // bytes at a time where SSE2 is available. The top and bottom rows holding something are
+  // found by scanning in from each end, and rows between them only have their cells outside
+  // of the rectangle found so far checked, so the scan stops early as soon as it can.
+  namespace _bounds_internal
+  {
+    template <typename T> size_t firstDifferent(const T *cells, size_t count, const T &background);
+    template <typename T> size_t lastDifferent(const T *cells, size_t count, const T &background);
+    template <typename RowFirst, typename RowLast> CellRect scan(unsigned int w, unsigned int h, RowFirst first, RowLast last);
+  }
+
+  // A single row of a Field2DView- a pointer and a length that can be iterated over.
+  template <typename T>
+  class Field2DRow
+  {
+  public:
+    // Constructor
+    Field2DRow(T *data, unsigned int length) : data_(data), length_(length) {  }
+
+    // Access
+    T *begin() const { return data_; }
+    T *end() const { return data_ + length_; }
+    T *Data() const { return data_; }
+    unsigned int Length() const { return length_; }
+    T &operator[](unsigned int x) const { return data_[x]; }
+
+  private:
+    // Variables
+    T *data_;
+    unsigned int length_;
+  };
+
+  // A non-owning look at a rectangle of a Field2D (or any strided 2D memory). Use a
+  // Field2DView<const T> for read-only access. Views have no index or other hidden state, so
+  // any number of them can be read from different threads at once, and walking the rows in
+  // order walks memory in order. A view is only good for as long as the memory it looks at.
   template <typename T>
+  class Field2DView
+  {
+  public:
+    // Walks the rows of a view from top to bottom.
+    class RowIterator
+    {
+    public:
+      RowIterator(T *row, unsigned int length, unsigned int stride) : row_(row), length_(length), stride_(stride) {  }
+      Field2DRow<T> operator*() const { return Field2DRow<T>(row_, length_); }
+      RowIterator &operator++() { row_ += stride_; return *this; }
+      bool operator ==(const RowIterator &rhs) const { return row_ == rhs.row_; }
+      bool operator !=(const RowIterator &rhs) const { return row_ != rhs.row_; }
+
+    private:
+      T *row_;
+      unsigned int length_;
+      unsigned int stride_;
+    };
+
+    // Constructors
+    Field2DView();
+    Field2DView(T *data, unsigned int w, unsigned int h, unsigned int stride);
+    template <typename U> Field2DView(const Field2DView<U> &rhs);
+
+    // Structure Info
+    unsigned int Width() const { return width_; }
+    unsigned int Height() const { return height_; }
+    unsigned int Stride() const { return stride_; }
+    bool Empty() const { return width_ == 0 || height_ == 0; }
+
+    // Access
+    T &At(unsigned int x, unsigned int y) const { return data_[x + static_cast<size_t>(y) * stride_]; }
+    T *RowData(unsigned int y) const { return data_ + static_cast<size_t>(y) * stride_; }
+    Field2DRow<T> Row(unsigned int y) const { return Field2DRow<T>(RowData(y), width_); }
+    Field2DView SubView(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const;
+    RowIterator begin() const { return RowIterator(data_, width_, stride_); }
+    RowIterator end() const { return RowIterator(data_ + static_cast<size_t>(height_) * stride_, width_, stride_); }
+
+  private:
+    // Variables
+    T *data_;
+    unsigned int width_;
+    unsigned int height_;
+    unsigned int stride_;
+  };
+
+  // A proxy class for the [] operator, allowing you to use the [] operator
+  template <typename T, typename Allocator = std::allocator<T> >
   class Field2DProxy
   {
     // Mark the Field2D as my friend!
-    friend Field2D<T>;
+    friend Field2D<T, Allocator>;
 
   public:
     // Operator Overload
@@ -380,10 +600,10 @@ namespace RConsole
 
   private:
     // Private constructor, friends only!
-    Field2DProxy(Field2D<T> *parentField, unsigned int xPos);
+    Field2DProxy(Field2D<T, Allocator> *parentField, unsigned int xPos);
 
     // Variables
-    Field2D<T> *field_;
+    Field2D<T, Allocator> *field_;
     const int x_;
   };
 
@@ -393,30 +613,40 @@ namespace RConsole
   // allowing cheap reading if you have the spot selected, with a single add.
   // Note that this is not guarded- if you reach the "end" of the width, it will
   // let you freely step onto the next row of the 2D array you have set up.
-  template <typename T>
+  // Memory comes from Allocator, and rows can be padded out with a RowAlignment so each one
+  // starts aligned. Rows are Stride() elements apart, which is the width unless padded, and
+  // raw indices (Peek(index), SetIndex, GetHead) step through the padding too.
+  template <typename T, typename Allocator>
   class Field2D
   {
     // Friensd can see ALL!
-    friend Field2DProxy<T>;
+    friend Field2DProxy<T, Allocator>;
 
   public:
     // Constructor
-    Field2D(unsigned int w, unsigned int h);
-    Field2D(unsigned int w, unsigned int h, const T defaultVal);
+    Field2D(unsigned int w, unsigned int h, const Allocator &alloc = Allocator());
+    Field2D(unsigned int w, unsigned int h, const T defaultVal, const Allocator &alloc = Allocator());
+    Field2D(unsigned int w, unsigned int h, RowAlignment alignment, const Allocator &alloc = Allocator());
+    Field2D(unsigned int w, unsigned int h, const T defaultVal, RowAlignment alignment, const Allocator &alloc = Allocator());
     Field2D &operator=(const Field2D &rhs);
+    Field2D &operator=(Field2D &&rhs);
     Field2D(const Field2D &rhs);
+    Field2D(Field2D &&rhs);
     ~Field2D();
+    void Resize(unsigned int w, unsigned int h, bool preserve = false);
 
     // Structure Info
     unsigned int Width() const;
     unsigned int Height() const;
     unsigned int Length() const;
+    unsigned int Stride() const;
+    const Allocator &GetAllocator() const;
 
     // Member Functions - Complex Manipulation
     void Zero();
     void Set(const T &newItem);
     T &Get(unsigned int x, unsigned int y);
-    Field2DProxy<T> operator[](unsigned int xPos);
+    Field2DProxy<T, Allocator> operator[](unsigned int xPos);
     void GoTo(unsigned int x, unsigned int y);
     const T& Get(unsigned int x, unsigned int y) const;
     const T& Peek(unsigned int x, unsigned int y) const;
@@ -424,9 +654,20 @@ namespace RConsole
     void Fill(const T &objToUse);
     void Fill(const T &objToUse, unsigned int startIndex, unsigned int endIndex);
 
+    // Bulk Manipulation - Rows and rectangles, not bounds checked.
+    void FillRow(unsigned int y, const T &objToUse);
+    void FillRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const T &objToUse);
+    void ClearRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    void CopyRow(unsigned int destY, const Field2D &source, unsigned int srcY);
+    void CopyRect(const Field2D &source, unsigned int srcX, unsigned int srcY, unsigned int w, unsigned int h, unsigned int destX, unsigned int destY);
+    void MoveRows(unsigned int srcY, unsigned int destY, unsigned int count);
+    void MoveRect(unsigned int srcX, unsigned int srcY, unsigned int w, unsigned int h, unsigned int destX, unsigned int destY);
+
     // Basic Manipulation
     T &Get();
     T* GetHead() { return data_; }
+    T *Row(unsigned int y) { return data_ + static_cast<size_t>(y) * stride_; }
+    const T *Row(unsigned int y) const { return data_ + static_cast<size_t>(y) * stride_; }
     const T &Get() const;
     void IncrementX();
     void IncrementY();
@@ -435,13 +676,98 @@ namespace RConsole
     unsigned int GetIndex();
     void SetIndex(unsigned int index);
 
+    // Views
+    Field2DView<T> View();
+    Field2DView<const T> View() const;
+    Field2DView<T> View(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    Field2DView<const T> View(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const;
+
+    // Searching
+    CellRect Bounds(const T &background) const;
+
   private:
+    // Private member functions - bulk helpers, picking a fast path for trivially copyable T.
+    static void fillCells(T *dest, size_t count, const T &value);
+    static void fillCells(T *dest, size_t count, const T &value, std::true_type);
+    static void fillCells(T *dest, size_t count, const T &value, std::false_type);
+    static void copyCells(T *dest, const T *source, size_t count);
+    static void moveCells(T *dest, const T *source, size_t count);
+    static void zeroCells(T *dest, size_t count, std::true_type);
+    static void zeroCells(T *dest, size_t count, std::false_type);
+    static unsigned int strideFor(unsigned int w, unsigned int alignment);
+    T *allocate(size_t count);
+    void release(T *data, size_t count);
+
     // Variables
     unsigned int index_;
     unsigned int width_;
     unsigned int height_;
+    unsigned int stride_;
+    unsigned int alignment_;
+    size_t capacity_;
+    Allocator alloc_;
     T *data_;
   };
+
+  // A 2D field stored as TileW by TileH tiles instead of plain rows, so small 2D neighborhoods
+  // (sprites, boxes, blobs) sit in a handful of cache lines. Every tile carries a dirty flag that
+  // is set by any mutable access, letting diffing and compositing skip tiles nobody touched.
+  // Rows are still cheap to stream through ReadRow/WriteRow, which move a tile-width at a time.
+  template <typename T, unsigned int TileW = 16, unsigned int TileH = 8, typename Allocator = std::allocator<T> >
+  class TiledField2D
+  {
+  public:
+    // Constructor
+    TiledField2D(unsigned int w, unsigned int h, const Allocator &alloc = Allocator());
+    TiledField2D(unsigned int w, unsigned int h, const T defaultVal, const Allocator &alloc = Allocator());
+    void Resize(unsigned int w, unsigned int h, bool preserve = false);
+
+    // Structure Info
+    unsigned int Width() const { return width_; }
+    unsigned int Height() const { return height_; }
+    unsigned int Length() const { return width_ * height_; }
+    unsigned int TilesX() const { return tilesX_; }
+    unsigned int TilesY() const { return tilesY_; }
+    static unsigned int TileWidth() { return TileW; }
+    static unsigned int TileHeight() { return TileH; }
+
+    // Member Functions - Same as Field2D. Mutable access marks the tile dirty.
+    void Zero();
+    void Fill(const T &objToUse);
+    T &Get(unsigned int x, unsigned int y);
+    const T &Get(unsigned int x, unsigned int y) const;
+    const T &Peek(unsigned int x, unsigned int y) const;
+
+    // Bulk Manipulation - Rows and rectangles, not bounds checked.
+    void FillRow(unsigned int y, const T &objToUse);
+    void FillRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const T &objToUse);
+    void ClearRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    void ReadRow(unsigned int x, unsigned int y, unsigned int count, T *dest) const;
+    void WriteRow(unsigned int x, unsigned int y, const T *source, unsigned int count);
+
+    // Linear conversion - copy into a row-major Field2D, optionally only the dirty tiles.
+    template <typename OtherAllocator> void CopyTo(Field2D<T, OtherAllocator> &dest) const;
+    template <typename OtherAllocator> void CopyDirtyTo(Field2D<T, OtherAllocator> &dest) const;
+
+    // Dirty tracking
+    bool IsTileDirty(unsigned int tileX, unsigned int tileY) const;
+    bool IsRowDirty(unsigned int y) const;
+    void ClearDirty();
+
+  private:
+    // Private member functions
+    size_t cellIndex(unsigned int x, unsigned int y) const;
+    void markDirty(unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    void copyTile(unsigned int tileX, unsigned int tileY, T *dest, unsigned int destStride, unsigned int w, unsigned int h) const;
+
+    // Variables
+    unsigned int width_;
+    unsigned int height_;
+    unsigned int tilesX_;
+    unsigned int tilesY_;
+    std::vector<T, Allocator> data_;
+    std::vector<unsigned char> dirty_;
+  };
 }
 
 
@@ -451,16 +777,16 @@ namespace RConsole
   //////////////////////////////////
  // Field2DProxy Methods and Co. //
 //////////////////////////////////
-  template <typename T>
-  Field2DProxy<T>::Field2DProxy(Field2D<T> *parentField, unsigned int xPos)
+  template <typename T, typename Allocator>
+  Field2DProxy<T, Allocator>::Field2DProxy(Field2D<T, Allocator> *parentField, unsigned int xPos)
     : field_(parentField)
     , x_(xPos)
   {  }
 
   // [] Operator Overload.
   // Note- This sets the current index!
-  template <typename T>
-  T &Field2DProxy<T>::operator[](unsigned int y)
+  template <typename T, typename Allocator>
+  T &Field2DProxy<T, Allocator>::operator[](unsigned int y)
   {
     field_->GoTo(x_, y);
     return field_->Get();
@@ -470,100 +796,252 @@ namespace RConsole
  // Structure Info //
 ////////////////////
 // Gets the width of the Field2D
-  template <typename T>
-  unsigned int Field2D<T>::Width() const
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::Width() const
   {
     return width_;
   }
 
   // Gets the height of the Field2D
-  template <typename T>
-  unsigned int Field2D<T>::Height() const
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::Height() const
   {
     return height_;
   }
 
-  template <typename T>
-  unsigned int Field2D<T>::Length() const
+  // Gets the number of elements in the Field2D, not counting row padding.
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::Length() const
   {
     return width_ * height_;
   }
 
+  // Gets the distance between the start of each row, in elements.
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::Stride() const
+  {
+    return stride_;
+  }
+
+  // Gets the allocator the Field2D gets its memory from.
+  template <typename T, typename Allocator>
+  const Allocator &Field2D<T, Allocator>::GetAllocator() const
+  {
+    return alloc_;
+  }
+
 
   /////////////////////////////
  // Field2D Methods and Co. //
 /////////////////////////////
 // Constructor
 // Defaults by setting everything to 0.
-  template <typename T>
-  Field2D<T>::Field2D(unsigned int w, unsigned int h)
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(unsigned int w, unsigned int h, const Allocator &alloc)
     : index_(0)
     , width_(w)
     , height_(h)
+    , stride_(w)
+    , alignment_(0)
+    , capacity_(static_cast<size_t>(w) * h)
+    , alloc_(alloc)
+    , data_(allocate(capacity_))
   {
-    data_ = new T[w * h];
     Zero();
   };
 
   // Sets all values to given default.
-  template <typename T>
-  Field2D<T>::Field2D(unsigned int w, unsigned int h, const T defaultVal)
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(unsigned int w, unsigned int h, const T defaultVal, const Allocator &alloc)
     : index_(0)
     , width_(w)
     , height_(h)
-    , data_(nullptr)
+    , stride_(w)
+    , alignment_(0)
+    , capacity_(static_cast<size_t>(w) * h)
+    , alloc_(alloc)
+    , data_(allocate(capacity_))
   {
-    T* adsf = new T[w * h];
-    data_ = adsf;
-    for (unsigned int i = 0; i < w; ++i)
-      for (unsigned int j = 0; j < h; ++j)
-      {
-        Set(defaultVal);
-        IncrementX();
-      }
-    index_ = 0;
+    Fill(defaultVal);
   }
 
-  template <typename T>
-  Field2D<T>::Field2D(const Field2D<T> &rhs)
+  // Zeroed, with each row padded to start on the given alignment.
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(unsigned int w, unsigned int h, RowAlignment alignment, const Allocator &alloc)
+    : index_(0)
+    , width_(w)
+    , height_(h)
+    , stride_(strideFor(w, alignment.Bytes))
+    , alignment_(alignment.Bytes)
+    , capacity_(static_cast<size_t>(stride_) * h)
+    , alloc_(alloc)
+    , data_(allocate(capacity_))
+  {
+    Zero();
+  }
+
+  // Sets all values to given default, with each row padded to start on the given alignment.
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(unsigned int w, unsigned int h, const T defaultVal, RowAlignment alignment, const Allocator &alloc)
+    : index_(0)
+    , width_(w)
+    , height_(h)
+    , stride_(strideFor(w, alignment.Bytes))
+    , alignment_(alignment.Bytes)
+    , capacity_(static_cast<size_t>(stride_) * h)
+    , alloc_(alloc)
+    , data_(allocate(capacity_))
   {
-    if (data_)
-      delete[] data_;
+    Fill(defaultVal);
+  }
 
-    data_ = new T[rhs.width_ * rhs.height_];
-    width_ = rhs.width_;
-    height_ = rhs.height_;
-    index_ = rhs.index_;
+  // Copy constructor
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(const Field2D<T, Allocator> &rhs)
+    : index_(rhs.index_)
+    , width_(rhs.width_)
+    , height_(rhs.height_)
+    , stride_(rhs.stride_)
+    , alignment_(rhs.alignment_)
+    , capacity_(static_cast<size_t>(rhs.stride_) * rhs.height_)
+    , alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(rhs.alloc_))
+    , data_(allocate(capacity_))
+  {
+    copyCells(data_, rhs.data_, capacity_);
+  }
 
-    for (unsigned int i = 0; i < width_ * height_; ++i)
-      data_[i] = rhs.data_[i];
+  // Move constructor, takes the memory of the other field and leaves it empty.
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::Field2D(Field2D<T, Allocator> &&rhs)
+    : index_(rhs.index_)
+    , width_(rhs.width_)
+    , height_(rhs.height_)
+    , stride_(rhs.stride_)
+    , alignment_(rhs.alignment_)
+    , capacity_(rhs.capacity_)
+    , alloc_(std::move(rhs.alloc_))
+    , data_(rhs.data_)
+  {
+    rhs.index_ = 0;
+    rhs.width_ = 0;
+    rhs.height_ = 0;
+    rhs.stride_ = 0;
+    rhs.capacity_ = 0;
+    rhs.data_ = nullptr;
   }
 
-  // Assignment operator
-  template <typename T>
-  Field2D<T> & Field2D<T>::operator=(const Field2D<T> &rhs)
+  // Assignment operator, reuses our memory if the other field fits in it.
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator> & Field2D<T, Allocator>::operator=(const Field2D<T, Allocator> &rhs)
   {
     if (&rhs != this)
     {
-      if (data_)
-        delete[] data_;
+      const size_t needed = static_cast<size_t>(rhs.stride_) * rhs.height_;
+      if (needed > capacity_)
+      {
+        release(data_, capacity_);
+        data_ = allocate(needed);
+        capacity_ = needed;
+      }
 
-      data_ = new T[rhs.width_ * rhs.height_];
       width_ = rhs.width_;
       height_ = rhs.height_;
+      stride_ = rhs.stride_;
+      alignment_ = rhs.alignment_;
       index_ = rhs.index_;
+      copyCells(data_, rhs.data_, needed);
+    }
+    return *this;
+  }
 
-      for (unsigned int i = 0; i < width_ * height_; ++i)
-        data_[i] = rhs.data_[i];
+  // Move assignment operator, swaps memory with the other field.
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator> & Field2D<T, Allocator>::operator=(Field2D<T, Allocator> &&rhs)
+  {
+    if (&rhs != this)
+    {
+      std::swap(index_, rhs.index_);
+      std::swap(width_, rhs.width_);
+      std::swap(height_, rhs.height_);
+      std::swap(stride_, rhs.stride_);
+      std::swap(alignment_, rhs.alignment_);
+      std::swap(capacity_, rhs.capacity_);
+      std::swap(alloc_, rhs.alloc_);
+      std::swap(data_, rhs.data_);
     }
     return *this;
   }
 
+  // Changes the size of the field in place. Nothing happens if the size is the same, and the
+  // existing memory is reused whenever the new size fits in it. If preserve is set, whatever
+  // overlaps between the old and new sizes keeps its position and the rest is zeroed,
+  // otherwise everything is zeroed. Resets the index.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::Resize(unsigned int w, unsigned int h, bool preserve)
+  {
+    if (w == width_ && h == height_)
+      return;
+
+    const unsigned int stride = strideFor(w, alignment_);
+    const size_t needed = static_cast<size_t>(stride) * h;
+    const unsigned int keepW = (w < width_) ? w : width_;
+    const unsigned int keepH = (h < height_) ? h : height_;
+    const unsigned int oldStride = stride_;
+    index_ = 0;
+
+    if (needed <= capacity_)
+    {
+      width_ = w;
+      height_ = h;
+      stride_ = stride;
+      if (!preserve)
+        return Zero();
+
+      // Slide rows to their new starting points, in the order that doesn't step on rows
+      // that haven't been moved yet.
+      if (stride < oldStride)
+      {
+        for (unsigned int y = 1; y < keepH; ++y)
+          moveCells(data_ + static_cast<size_t>(y) * stride, data_ + static_cast<size_t>(y) * oldStride, keepW);
+      }
+      else if (stride > oldStride)
+      {
+        for (unsigned int y = keepH; y-- > 1;)
+          moveCells(data_ + static_cast<size_t>(y) * stride, data_ + static_cast<size_t>(y) * oldStride, keepW);
+      }
+    }
+    else
+    {
+      T *old = data_;
+      const size_t oldCapacity = capacity_;
+      data_ = allocate(needed);
+      capacity_ = needed;
+      width_ = w;
+      height_ = h;
+      stride_ = stride;
+      if (!preserve)
+      {
+        release(old, oldCapacity);
+        return Zero();
+      }
+
+      for (unsigned int y = 0; y < keepH; ++y)
+        copyCells(data_ + static_cast<size_t>(y) * stride, old + static_cast<size_t>(y) * oldStride, keepW);
+      release(old, oldCapacity);
+    }
+
+    // Clear what wasn't covered by the old size.
+    if (w > keepW)
+      ClearRect(keepW, 0, w - keepW, keepH);
+    if (h > keepH)
+      ClearRect(0, keepH, w, h - keepH);
+  }
+
   // Destructor
-  template <typename T>
-  Field2D<T>::~Field2D()
+  template <typename T, typename Allocator>
+  Field2D<T, Allocator>::~Field2D()
   {
-    delete[] data_;
+    release(data_, capacity_);
   }
 
   ////////////////////////
@@ -571,832 +1049,3264 @@ namespace RConsole
 ////////////////////////
 // Get the item at the position X, Y.
 // Does not set the actual index of the Field!
-  template <typename T>
-  T &Field2D<T>::Get(unsigned int x, unsigned int y)
+  template <typename T, typename Allocator>
+  T &Field2D<T, Allocator>::Get(unsigned int x, unsigned int y)
   {
     GoTo(x, y);
     return Get();
   }
 
-  // Const version of get that returns const reference.
-  template <typename T>
-  const T &Field2D<T>::Get(unsigned int x, unsigned int y) const
+  // Const version of get that returns const reference. Like Peek, does not set the index.
+  template <typename T, typename Allocator>
+  const T &Field2D<T, Allocator>::Get(unsigned int x, unsigned int y) const
   {
-    GoTo(x, y);
-    return Get();
+    return Peek(x, y);
   }
 
   // Get the first part of a 2D array operator
-  template <typename T>
-  Field2DProxy<T> Field2D<T>::operator[](unsigned int xPos)
+  template <typename T, typename Allocator>
+  Field2DProxy<T, Allocator> Field2D<T, Allocator>::operator[](unsigned int xPos)
   {
-    return Field2DProxy<T>(this, xPos);
+    return Field2DProxy<T, Allocator>(this, xPos);
   }
 
   // Set the value at the current index
-  template <typename T>
-  void Field2D<T>::Set(const T &newItem)
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::Set(const T &newItem)
   {
     data_[index_] = newItem;
   }
 
   // Glance at a read-only version of a specified location. Does NOT set index.
-  template <typename T>
-  const T& Field2D<T>::Peek(unsigned int x, unsigned int y) const
+  template <typename T, typename Allocator>
+  const T& Field2D<T, Allocator>::Peek(unsigned int x, unsigned int y) const
   {
-    return data_[x + y * width_];
+    return data_[x + static_cast<size_t>(y) * stride_];
   }
 
   // Get the value at the specified index.
-  template <typename T>
-  const T& Field2D<T>::Peek(unsigned int index) const
+  template <typename T, typename Allocator>
+  const T& Field2D<T, Allocator>::Peek(unsigned int index) const
   {
     return data_[index];
   }
 
   // Chance selected index to specified point.
-  template <typename T>
-  void Field2D<T>::GoTo(unsigned int x, unsigned int y)
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::GoTo(unsigned int x, unsigned int y)
   {
-    index_ = x + y * width_;
+    index_ = x + y * stride_;
   }
 
   // Sets all memory to 0. Does NOT modify index!
-  template <typename T>
-  void Field2D<T>::Zero()
+  // Types that can't be safely zeroed byte by byte are set to T() instead.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::Zero()
   {
-    memset(data_, 0, sizeof(T) * width_ * height_);
+    zeroCells(data_, static_cast<size_t>(stride_) * height_, std::is_trivially_copyable<T>());
   }
 
   // Sets all memory to whatever you want.
-  template <typename T>
-  void Field2D<T>::Fill(const T &objToUse)
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::Fill(const T &objToUse)
   {
-    Fill(objToUse, 0, Length());
+    Fill(objToUse, 0, stride_ * height_);
   }
 
   // Fills a specific range to whatever I want, inclusive for start index and
   // excludes end index.
-  template <typename T>
-  void Field2D<T>::Fill(const T &objToUse, unsigned int startIndex, unsigned int endIndex)
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::Fill(const T &objToUse, unsigned int startIndex, unsigned int endIndex)
   {
-    unsigned int prevIndex = index_;
-    index_ = startIndex;
-    for (unsigned int i = startIndex; i < endIndex; ++i)
-    {
-      Set(objToUse);
-      IncrementX();
-    }
-    index_ = prevIndex;
+    if (endIndex > startIndex)
+      fillCells(data_ + startIndex, endIndex - startIndex, objToUse);
   }
 
-  //////////////////////
- // Cheap operations //
-//////////////////////
-// Get the value at the current index.
-  template <typename T>
-  T &Field2D<T>::Get()
+  /////////////////////
+ // Bulk Operations //
+/////////////////////
+// Sets an entire row to the given value.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::FillRow(unsigned int y, const T &objToUse)
   {
-    return data_[index_];
+    fillCells(Row(y), width_, objToUse);
   }
 
-  // Const get.
-  template <typename T>
-  const T& Field2D<T>::Get() const
+  // Sets every element in a rectangle to the given value.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::FillRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const T &objToUse)
   {
-    return data_[index_];
+    if (w == stride_ && x == 0)
+      return fillCells(Row(y), static_cast<size_t>(w) * h, objToUse);
+
+    for (unsigned int row = y; row < y + h; ++row)
+      fillCells(Row(row) + x, w, objToUse);
   }
 
-  // Increment X location by 1 in the 2D field
-  template <typename T>
-  void Field2D<T>::IncrementX()
+  // Resets every element in a rectangle, the same way Zero does.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::ClearRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h)
   {
-    ++index_;
+    for (unsigned int row = y; row < y + h; ++row)
+      zeroCells(Row(row) + x, w, std::is_trivially_copyable<T>());
   }
 
-  // Increment Y location by 1 in the 2D field
-  template <typename T>
-  void Field2D<T>::IncrementY()
+  // Copies a whole row from another field of the same width.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::CopyRow(unsigned int destY, const Field2D &source, unsigned int srcY)
   {
-    index_ += width_;
+    copyCells(Row(destY), source.Row(srcY), width_);
   }
 
-  // Decrement X location by 1 in the 2D field
-  template <typename T>
-  void Field2D<T>::DecrementX()
+  // Copies a rectangle from another field into this one. The two must not be the same field,
+  // use MoveRect for that.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::CopyRect(const Field2D &source, unsigned int srcX, unsigned int srcY, unsigned int w, unsigned int h, unsigned int destX, unsigned int destY)
   {
-    --index_;
+    for (unsigned int row = 0; row < h; ++row)
+      copyCells(Row(destY + row) + destX, source.Row(srcY + row) + srcX, w);
   }
 
-  // Decrement Y location by 1 in the 2D Field
-  template <typename T>
-  void Field2D<T>::DecrementY()
+  // Moves count rows from srcY to destY within this field. The ranges may overlap,
+  // so this works for scrolling in either direction.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::MoveRows(unsigned int srcY, unsigned int destY, unsigned int count)
   {
-    index_ -= width_;
+    moveCells(Row(destY), Row(srcY), static_cast<size_t>(count) * stride_);
   }
 
-  // Gets the index that the 2D Field currently has.
-  template <typename T>
-  unsigned int Field2D<T>::GetIndex()
+  // Moves a rectangle within this field. The source and destination may overlap.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::MoveRect(unsigned int srcX, unsigned int srcY, unsigned int w, unsigned int h, unsigned int destX, unsigned int destY)
   {
-    return index_;
+    // Walk rows in the order that won't overwrite rows we haven't moved yet.
+    if (destY <= srcY)
+    {
+      for (unsigned int row = 0; row < h; ++row)
+        moveCells(Row(destY + row) + destX, Row(srcY + row) + srcX, w);
+    }
+    else
+    {
+      for (unsigned int row = h; row-- > 0;)
+        moveCells(Row(destY + row) + destX, Row(srcY + row) + srcX, w);
+    }
   }
 
-  // Gets the index that the 2D Field currently has.
-  template <typename T>
-  void Field2D<T>::SetIndex(unsigned int index)
+  // Fill count elements starting at dest.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::fillCells(T *dest, size_t count, const T &value)
   {
-    index_ = index;
+    fillCells(dest, count, value, std::is_trivially_copyable<T>());
   }
-}
 
+  // Trivially copyable fill. Single bytes are a memset. Anything else seeds a small block and
+  // then copies it forward with memcpy, so the bulk of the work is done by wide stores. The
+  // block is capped so the source stays in L1 cache while it is copied from.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::fillCells(T *dest, size_t count, const T &value, std::true_type)
+  {
+    if (count == 0)
+      return;
+    if (sizeof(T) == 1)
+    {
+      unsigned char byte;
+      memcpy(&byte, &value, 1);
+      memset(static_cast<void *>(dest), byte, count);
+      return;
+    }
 
-namespace RConsole
-{
-#define DEFAULT_WIDTH (_rlutil_internal::tcols() - 1)
-#define DEFAULT_HEIGHT _rlutil_internal::trows()
+    const size_t maxBlock = (4096 / sizeof(T)) > 0 ? (4096 / sizeof(T)) : 1;
+    size_t filled = (count < 8) ? count : 8;
+    for (size_t i = 0; i < filled; ++i)
+      dest[i] = value;
 
-  //Colors!
-  enum Color
+    while (filled < count)
+    {
+      size_t block = (filled < maxBlock) ? filled : maxBlock;
+      if (block > count - filled)
+        block = count - filled;
+      memcpy(static_cast<void *>(dest + filled), dest, block * sizeof(T));
+      filled += block;
+    }
+  }
+
+  // General fill.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::fillCells(T *dest, size_t count, const T &value, std::false_type)
   {
-    //Acquire _rlutil_internal info where possible--
-    BLACK = _rlutil_internal::BLACK,
-    BLUE = _rlutil_internal::BLUE,
-    GREEN = _rlutil_internal::GREEN,
-    CYAN = _rlutil_internal::CYAN,
-    RED = _rlutil_internal::RED,
-    MAGENTA = _rlutil_internal::MAGENTA,
-    BROWN = _rlutil_internal::BROWN,
-    GREY = _rlutil_internal::GREY,
-    DARKGREY = _rlutil_internal::DARKGREY,
-    LIGHTBLUE = _rlutil_internal::LIGHTBLUE,
-    LIGHTGREEN = _rlutil_internal::LIGHTGREEN,
-    LIGHTCYAN = _rlutil_internal::LIGHTCYAN,
-    LIGHTRED = _rlutil_internal::LIGHTRED,
-    LIGHTMAGENTA = _rlutil_internal::LIGHTMAGENTA,
-    YELLOW = _rlutil_internal::YELLOW,
-    WHITE = _rlutil_internal::WHITE,
+    std::fill_n(dest, count, value);
+  }
 
-    // Add custom values
-    //DEFAULT = _rlutil_internal::DEFAULT, // BROKEN //Added custom to the _rlutil_internal header.
-    PREVIOUS_COLOR
-  };
+  // Copy count elements that don't overlap.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::copyCells(T *dest, const T *source, size_t count)
+  {
+    if (count == 0)
+      return;
+    if (std::is_trivially_copyable<T>::value)
+      memcpy(static_cast<void *>(dest), static_cast<const void *>(source), count * sizeof(T));
+    else
+      std::copy(source, source + count, dest);
+  }
 
-  // The raster info struct, holds info on what is to be drawn at a location and the color.
-  struct RasterInfo
+  // Copy count elements that may overlap.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::moveCells(T *dest, const T *source, size_t count)
   {
-    RasterInfo();
-    RasterInfo(const char val, Color col);
-    bool operator ==(const RasterInfo &rhs) const;
-    bool operator !=(const RasterInfo &rhs) const;
-    char Value;
-    Color C;
+    if (std::is_trivially_copyable<T>::value)
+      memmove(static_cast<void *>(dest), static_cast<const void *>(source), count * sizeof(T));
+    else if (dest < source)
+      std::copy(source, source + count, dest);
+    else if (dest > source)
+      std::copy_backward(source, source + count, dest + count);
+  }
+
+  // Works out how many elements apart rows need to be so each starts on a multiple of
+  // alignment bytes. The stride is the width rounded up to the smallest step that keeps
+  // that true for every row.
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::strideFor(unsigned int w, unsigned int alignment)
+  {
+    if (alignment == 0)
+      return w;
+
+    unsigned int a = static_cast<unsigned int>(sizeof(T));
+    unsigned int b = alignment;
+    while (b != 0)
+    {
+      const unsigned int t = a % b;
+      a = b;
+      b = t;
+    }
+
+    const unsigned int step = alignment / a;
+    return ((w + step - 1) / step) * step;
+  }
+
+  // Allocates and constructs count elements. Types with a trivial default constructor are
+  // left as is, since every constructor writes over them before they are read.
+  template <typename T, typename Allocator>
+  T *Field2D<T, Allocator>::allocate(size_t count)
+  {
+    if (count == 0)
+      return nullptr;
+
+    T *data = std::allocator_traits<Allocator>::allocate(alloc_, count);
+    if (!std::is_trivially_default_constructible<T>::value)
+      for (size_t i = 0; i < count; ++i)
+        std::allocator_traits<Allocator>::construct(alloc_, data + i);
+    return data;
+  }
+
+  // Destroys and frees count elements.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::release(T *data, size_t count)
+  {
+    if (data == nullptr)
+      return;
+
+    if (!std::is_trivially_destructible<T>::value)
+      for (size_t i = 0; i < count; ++i)
+        std::allocator_traits<Allocator>::destroy(alloc_, data + i);
+    std::allocator_traits<Allocator>::deallocate(alloc_, data, count);
+  }
+
+  // Zero the bytes of count elements.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::zeroCells(T *dest, size_t count, std::true_type)
+  {
+    // Empty fields have no storage, and memset can't be handed null even for nothing.
+    if (count == 0)
+      return;
+    memset(static_cast<void *>(dest), 0, count * sizeof(T));
+  }
+
+  // Value initialize count elements, since their bytes can't just be zeroed.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::zeroCells(T *dest, size_t count, std::false_type)
+  {
+    std::fill_n(dest, count, T());
+  }
+
+  ///////////////////////
+ // Aligned Allocator //
+///////////////////////
+// Over-allocates so the block can be shifted up to the alignment, and keeps the original
+// pointer just before the aligned block so it can be freed later.
+  template <typename T, size_t Alignment>
+  T *AlignedAllocator<T, Alignment>::allocate(size_t count)
+  {
+    const size_t extra = Alignment + sizeof(void *);
+    char *raw = static_cast<char *>(::operator new(count * sizeof(T) + extra));
+    const uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void *);
+    char *aligned = reinterpret_cast<char *>((start + Alignment - 1) & ~(static_cast<uintptr_t>(Alignment) - 1));
+    reinterpret_cast<void **>(aligned)[-1] = raw;
+    return reinterpret_cast<T *>(aligned);
+  }
+
+  // Frees memory from allocate.
+  template <typename T, size_t Alignment>
+  void AlignedAllocator<T, Alignment>::deallocate(T *ptr, size_t)
+  {
+    if (ptr)
+      ::operator delete(reinterpret_cast<void **>(ptr)[-1]);
+  }
+
+  /////////////////////
+ // Arena Allocator //
+/////////////////////
+// Takes aligned memory from the arena.
+  template <typename T, size_t Alignment>
+  T *ArenaAllocator<T, Alignment>::allocate(size_t count)
+  {
+    const size_t alignment = (Alignment > alignof(T)) ? Alignment : alignof(T);
+    return static_cast<T *>(arena_->Allocate(count * sizeof(T), alignment));
+  }
+
+  // Arena memory is only given back when the arena is reset or destroyed.
+  template <typename T, size_t Alignment>
+  void ArenaAllocator<T, Alignment>::deallocate(T *, size_t)
+  {  }
+
+  ///////////
+ // Views //
+///////////
+// A view of the whole field.
+  template <typename T, typename Allocator>
+  Field2DView<T> Field2D<T, Allocator>::View()
+  {
+    return Field2DView<T>(data_, width_, height_, stride_);
+  }
+
+  // A read-only view of the whole field.
+  template <typename T, typename Allocator>
+  Field2DView<const T> Field2D<T, Allocator>::View() const
+  {
+    return Field2DView<const T>(data_, width_, height_, stride_);
+  }
+
+  // A view of a rectangle of the field, clipped to the field.
+  template <typename T, typename Allocator>
+  Field2DView<T> Field2D<T, Allocator>::View(unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+  {
+    return View().SubView(x, y, w, h);
+  }
+
+  // A read-only view of a rectangle of the field, clipped to the field.
+  template <typename T, typename Allocator>
+  Field2DView<const T> Field2D<T, Allocator>::View(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const
+  {
+    return View().SubView(x, y, w, h);
+  }
+
+  ///////////////
+ // Searching //
+///////////////
+// The smallest rectangle holding every cell that isn't background. Cells that are trivially
+// copyable are compared by their bytes, so for floats 0 and -0 differ.
+  template <typename T, typename Allocator>
+  CellRect Field2D<T, Allocator>::Bounds(const T &background) const
+  {
+    return _bounds_internal::scan(width_, height_,
+      [this, &background](unsigned int y, unsigned int start, unsigned int end)
+      {
+        return start + static_cast<unsigned int>(_bounds_internal::firstDifferent(Row(y) + start, end - start, background));
+      },
+      [this, &background](unsigned int y, unsigned int start, unsigned int end)
+      {
+        return start + static_cast<unsigned int>(_bounds_internal::lastDifferent(Row(y) + start, end - start, background));
+      });
+  }
+
+  namespace _bounds_internal
+  {
+    // Whether cells can be compared 16 bytes at a time.
+    template <typename T>
+    struct ByteComparable : std::integral_constant<bool, std::is_trivially_copyable<T>::value && (16 % sizeof(T)) == 0> {  };
+
+    // Index of the first cell that isn't background, or count if there isn't one.
+    template <typename T>
+    size_t firstDifferent(const T *cells, size_t count, const T &background, std::false_type)
+    {
+      for (size_t i = 0; i < count; ++i)
+        if (!(cells[i] == background))
+          return i;
+      return count;
+    }
+
+    // One past the last cell that isn't background, or 0 if there isn't one.
+    template <typename T>
+    size_t lastDifferent(const T *cells, size_t count, const T &background, std::false_type)
+    {
+      for (size_t i = count; i > 0; --i)
+        if (!(cells[i - 1] == background))
+          return i;
+      return 0;
+    }
+
+#ifdef RConsole_HAS_SSE2
+    // 16 bytes of background cells back to back.
+    template <typename T>
+    __m128i backgroundBlock(const T &background)
+    {
+      unsigned char bytes[16];
+      for (size_t i = 0; i < 16; i += sizeof(T))
+        memcpy(bytes + i, &background, sizeof(T));
+      return _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    }
+
+    // Whole blocks are compared until one differs, then its cells are checked one at a time.
+    template <typename T>
+    size_t firstDifferent(const T *cells, size_t count, const T &background, std::true_type)
+    {
+      const size_t perBlock = 16 / sizeof(T);
+      const __m128i match = backgroundBlock(background);
+      size_t i = 0;
+      for (; i + perBlock <= count; i += perBlock)
+      {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, match)) != 0xFFFF)
+          break;
+      }
+
+      for (; i < count; ++i)
+        if (memcmp(cells + i, &background, sizeof(T)) != 0)
+          return i;
+      return count;
+    }
+
+    // The same from the other end.
+    template <typename T>
+    size_t lastDifferent(const T *cells, size_t count, const T &background, std::true_type)
+    {
+      const size_t perBlock = 16 / sizeof(T);
+      const __m128i match = backgroundBlock(background);
+      size_t i = count;
+      for (; i >= perBlock; i -= perBlock)
+      {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i - perBlock));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, match)) != 0xFFFF)
+          break;
+      }
+
+      for (; i > 0; --i)
+        if (memcmp(cells + i - 1, &background, sizeof(T)) != 0)
+          return i;
+      return 0;
+    }
+#endif
+
+    // Picks the fastest comparison the cells allow.
+    template <typename T>
+    size_t firstDifferent(const T *cells, size_t count, const T &background)
+    {
+#ifdef RConsole_HAS_SSE2
+      return firstDifferent(cells, count, background, ByteComparable<T>());
+#else
+      return firstDifferent(cells, count, background, std::false_type());
+#endif
+    }
+
+    template <typename T>
+    size_t lastDifferent(const T *cells, size_t count, const T &background)
+    {
+#ifdef RConsole_HAS_SSE2
+      return lastDifferent(cells, count, background, ByteComparable<T>());
+#else
+      return lastDifferent(cells, count, background, std::false_type());
+#endif
+    }
+
+    // Bounding rectangle of a w by h field. first(y, start, end) gives the first cell in
+    // [start, end) of row y that isn't background, or end, and last(y, start, end) gives one
+    // past the last, or start.
+    template <typename RowFirst, typename RowLast>
+    CellRect scan(unsigned int w, unsigned int h, RowFirst first, RowLast last)
+    {
+      if (w == 0)
+        return CellRect();
+
+      // Top and bottom rows with anything in them.
+      unsigned int top = 0;
+      unsigned int left = w;
+      while (top < h && (left = first(top, 0, w)) == w)
+        ++top;
+      if (top == h)
+        return CellRect();
+      unsigned int right = last(top, left, w);
+
+      unsigned int bottom = h - 1;
+      unsigned int bottomRight = 0;
+      while (bottom > top && (bottomRight = last(bottom, 0, w)) == 0)
+        --bottom;
+      if (bottom > top)
+      {
+        left = first(bottom, 0, left);
+        if (bottomRight > right)
+          right = bottomRight;
+      }
+
+      // Rows in between can only push the sides further out.
+      for (unsigned int y = top + 1; y < bottom && (left > 0 || right < w); ++y)
+      {
+        if (left > 0)
+          left = first(y, 0, left);
+        if (right < w)
+          right = last(y, right, w);
+      }
+
+      return CellRect(left, top, right - left, bottom - top + 1);
+    }
+  }
+
+  /////////////////
+ // Field2DView //
+/////////////////
+// An empty view.
+  template <typename T>
+  Field2DView<T>::Field2DView()
+    : data_(nullptr)
+    , width_(0)
+    , height_(0)
+    , stride_(0)
+  {  }
+
+  // A view of w by h elements starting at data, with rows stride elements apart.
+  template <typename T>
+  Field2DView<T>::Field2DView(T *data, unsigned int w, unsigned int h, unsigned int stride)
+    : data_(data)
+    , width_(w)
+    , height_(h)
+    , stride_(stride)
+  {  }
+
+  // Converts between compatible views, such as a mutable view to a read-only one.
+  template <typename T>
+  template <typename U>
+  Field2DView<T>::Field2DView(const Field2DView<U> &rhs)
+    : data_(rhs.RowData(0))
+    , width_(rhs.Width())
+    , height_(rhs.Height())
+    , stride_(rhs.Stride())
+  {  }
+
+  // A view of a rectangle of this view, clipped to this view.
+  template <typename T>
+  Field2DView<T> Field2DView<T>::SubView(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const
+  {
+    if (x >= width_ || y >= height_)
+      return Field2DView();
+    if (w > width_ - x)
+      w = width_ - x;
+    if (h > height_ - y)
+      h = height_ - y;
+
+    return Field2DView(data_ + x + static_cast<size_t>(y) * stride_, w, h, stride_);
+  }
+
+  //////////////////////
+ // Cheap operations //
+//////////////////////
+// Get the value at the current index.
+  template <typename T, typename Allocator>
+  T &Field2D<T, Allocator>::Get()
+  {
+    return data_[index_];
+  }
+
+  // Const get.
+  template <typename T, typename Allocator>
+  const T& Field2D<T, Allocator>::Get() const
+  {
+    return data_[index_];
+  }
+
+  // Increment X location by 1 in the 2D field
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::IncrementX()
+  {
+    ++index_;
+  }
+
+  // Increment Y location by 1 in the 2D field
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::IncrementY()
+  {
+    index_ += stride_;
+  }
+
+  // Decrement X location by 1 in the 2D field
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::DecrementX()
+  {
+    --index_;
+  }
+
+  // Decrement Y location by 1 in the 2D Field
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::DecrementY()
+  {
+    index_ -= stride_;
+  }
+
+  // Gets the index that the 2D Field currently has.
+  template <typename T, typename Allocator>
+  unsigned int Field2D<T, Allocator>::GetIndex()
+  {
+    return index_;
+  }
+
+  // Gets the index that the 2D Field currently has.
+  template <typename T, typename Allocator>
+  void Field2D<T, Allocator>::SetIndex(unsigned int index)
+  {
+    index_ = index;
+  }
+
+  ///////////////////
+ // Tiled Field2D //
+///////////////////
+// Constructor, cells start value-initialized.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  TiledField2D<T, TileW, TileH, Allocator>::TiledField2D(unsigned int w, unsigned int h, const Allocator &alloc)
+    : TiledField2D(w, h, T(), alloc)
+  {  }
+
+  // Constructor with a default value for every cell. Everything starts dirty.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  TiledField2D<T, TileW, TileH, Allocator>::TiledField2D(unsigned int w, unsigned int h, const T defaultVal, const Allocator &alloc)
+    : width_(w)
+    , height_(h)
+    , tilesX_((w + TileW - 1) / TileW)
+    , tilesY_((h + TileH - 1) / TileH)
+    , data_(static_cast<size_t>(tilesX_) * tilesY_ * TileW * TileH, defaultVal, alloc)
+    , dirty_(static_cast<size_t>(tilesX_) * tilesY_, 1)
+  {  }
+
+  // Resizes the field. With preserve set the overlapping cells are kept, otherwise the field
+  // is value-initialized. Everything is marked dirty either way.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::Resize(unsigned int w, unsigned int h, bool preserve)
+  {
+    if (w == width_ && h == height_)
+      return;
+
+    TiledField2D resized(w, h, T(), data_.get_allocator());
+    if (preserve)
+    {
+      const unsigned int keepW = std::min(w, width_);
+      const unsigned int keepH = std::min(h, height_);
+      std::vector<T> row(keepW);
+      for (unsigned int y = 0; y < keepH; ++y)
+      {
+        ReadRow(0, y, keepW, row.data());
+        resized.WriteRow(0, y, row.data(), keepW);
+      }
+    }
+
+    std::swap(width_, resized.width_);
+    std::swap(height_, resized.height_);
+    std::swap(tilesX_, resized.tilesX_);
+    std::swap(tilesY_, resized.tilesY_);
+    data_.swap(resized.data_);
+    dirty_.swap(resized.dirty_);
+    std::fill(dirty_.begin(), dirty_.end(), static_cast<unsigned char>(1));
+  }
+
+  // Sets every cell to a value-initialized T.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::Zero()
+  {
+    Fill(T());
+  }
+
+  // Sets every cell to the object provided.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::Fill(const T &objToUse)
+  {
+    std::fill(data_.begin(), data_.end(), objToUse);
+    std::fill(dirty_.begin(), dirty_.end(), static_cast<unsigned char>(1));
+  }
+
+  // Get the cell at a location for writing, marking its tile dirty.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  T &TiledField2D<T, TileW, TileH, Allocator>::Get(unsigned int x, unsigned int y)
+  {
+    dirty_[(y / TileH) * tilesX_ + x / TileW] = 1;
+    return data_[cellIndex(x, y)];
+  }
+
+  // Const get, does not touch dirty flags.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  const T &TiledField2D<T, TileW, TileH, Allocator>::Get(unsigned int x, unsigned int y) const
+  {
+    return data_[cellIndex(x, y)];
+  }
+
+  // Looks at a cell without marking anything.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  const T &TiledField2D<T, TileW, TileH, Allocator>::Peek(unsigned int x, unsigned int y) const
+  {
+    return data_[cellIndex(x, y)];
+  }
+
+  // Fills row y with the object provided.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::FillRow(unsigned int y, const T &objToUse)
+  {
+    FillRect(0, y, width_, 1, objToUse);
+  }
+
+  // Fills the w by h rectangle at x, y, one tile-width run at a time.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::FillRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h, const T &objToUse)
+  {
+    for (unsigned int j = y; j < y + h; ++j)
+    {
+      unsigned int i = x;
+      while (i < x + w)
+      {
+        const unsigned int run = std::min(TileW - i % TileW, x + w - i);
+        std::fill_n(data_.begin() + cellIndex(i, j), run, objToUse);
+        i += run;
+      }
+    }
+
+    markDirty(x, y, w, h);
+  }
+
+  // Sets the w by h rectangle at x, y to a value-initialized T.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::ClearRect(unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+  {
+    FillRect(x, y, w, h, T());
+  }
+
+  // Row-major fast path: copies count cells of row y starting at x out into dest.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::ReadRow(unsigned int x, unsigned int y, unsigned int count, T *dest) const
+  {
+    const unsigned int end = x + count;
+    while (x < end)
+    {
+      const unsigned int run = std::min(TileW - x % TileW, end - x);
+      std::copy_n(data_.begin() + cellIndex(x, y), run, dest);
+      dest += run;
+      x += run;
+    }
+  }
+
+  // Row-major fast path: copies count cells from source into row y starting at x.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::WriteRow(unsigned int x, unsigned int y, const T *source, unsigned int count)
+  {
+    markDirty(x, y, count, 1);
+
+    const unsigned int end = x + count;
+    while (x < end)
+    {
+      const unsigned int run = std::min(TileW - x % TileW, end - x);
+      std::copy_n(source, run, data_.begin() + cellIndex(x, y));
+      source += run;
+      x += run;
+    }
+  }
+
+  // Copies the whole field into a row-major Field2D, clipped to whichever is smaller.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  template <typename OtherAllocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::CopyTo(Field2D<T, OtherAllocator> &dest) const
+  {
+    const unsigned int w = std::min(width_, dest.Width());
+    const unsigned int h = std::min(height_, dest.Height());
+    for (unsigned int ty = 0; ty * TileH < h; ++ty)
+      for (unsigned int tx = 0; tx * TileW < w; ++tx)
+        copyTile(tx, ty, dest.Row(0), dest.Stride(), w, h);
+  }
+
+  // Copies only the tiles marked dirty into a row-major Field2D, clipped to whichever is smaller.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  template <typename OtherAllocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::CopyDirtyTo(Field2D<T, OtherAllocator> &dest) const
+  {
+    const unsigned int w = std::min(width_, dest.Width());
+    const unsigned int h = std::min(height_, dest.Height());
+    for (unsigned int ty = 0; ty * TileH < h; ++ty)
+      for (unsigned int tx = 0; tx * TileW < w; ++tx)
+        if (dirty_[ty * tilesX_ + tx])
+          copyTile(tx, ty, dest.Row(0), dest.Stride(), w, h);
+  }
+
+  // Whether anything in the given tile was written since the last ClearDirty.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  bool TiledField2D<T, TileW, TileH, Allocator>::IsTileDirty(unsigned int tileX, unsigned int tileY) const
+  {
+    return dirty_[tileY * tilesX_ + tileX] != 0;
+  }
+
+  // Whether any tile overlapping row y was written since the last ClearDirty.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  bool TiledField2D<T, TileW, TileH, Allocator>::IsRowDirty(unsigned int y) const
+  {
+    const unsigned char *flags = dirty_.data() + (y / TileH) * tilesX_;
+    return std::find(flags, flags + tilesX_, static_cast<unsigned char>(1)) != flags + tilesX_;
+  }
+
+  // Marks every tile clean, usually right after the field has been presented.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::ClearDirty()
+  {
+    std::fill(dirty_.begin(), dirty_.end(), static_cast<unsigned char>(0));
+  }
+
+  // Where the cell at x, y lives: tiles are stored row-major, as are cells within a tile.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  size_t TiledField2D<T, TileW, TileH, Allocator>::cellIndex(unsigned int x, unsigned int y) const
+  {
+    const size_t tile = static_cast<size_t>(y / TileH) * tilesX_ + x / TileW;
+    return tile * (TileW * TileH) + (y % TileH) * TileW + x % TileW;
+  }
+
+  // Marks every tile overlapping the w by h rectangle at x, y as dirty.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::markDirty(unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+  {
+    if (w == 0 || h == 0)
+      return;
+
+    for (unsigned int ty = y / TileH; ty <= (y + h - 1) / TileH; ++ty)
+      for (unsigned int tx = x / TileW; tx <= (x + w - 1) / TileW; ++tx)
+        dirty_[ty * tilesX_ + tx] = 1;
+  }
+
+  // Copies one tile into row-major memory, skipping anything past w by h.
+  template <typename T, unsigned int TileW, unsigned int TileH, typename Allocator>
+  void TiledField2D<T, TileW, TileH, Allocator>::copyTile(unsigned int tileX, unsigned int tileY, T *dest, unsigned int destStride, unsigned int w, unsigned int h) const
+  {
+    const unsigned int x = tileX * TileW;
+    const unsigned int y = tileY * TileH;
+    const unsigned int runW = std::min(TileW, w - x);
+    const unsigned int runH = std::min(TileH, h - y);
+    const T *source = data_.data() + (static_cast<size_t>(tileY) * tilesX_ + tileX) * (TileW * TileH);
+
+    for (unsigned int j = 0; j < runH; ++j)
+      std::copy_n(source + j * TileW, runW, dest + x + static_cast<size_t>(y + j) * destStride);
+  }
+}
+
+
+namespace RConsole
+{
+#define DEFAULT_WIDTH (TerminalSize::Width() - 1)
+#define DEFAULT_HEIGHT TerminalSize::Height()
+
+  // Keeps track of the size of the terminal without asking the OS on every read. On POSIX a
+  // SIGWINCH handler only raises a flag, and the size is queried again the next time it is
+  // read. Windows has no resize signal, so there the size is queried whenever it is polled.
+  // Falls back to 80x24 when output isn't a terminal.
+  class TerminalSize
+  {
+  public:
+    // Static member functions
+    static void Install();
+    static unsigned int Width();
+    static unsigned int Height();
+    static unsigned long Poll();
+
+  private:
+    // Private methods.
+    static void refresh();
+    static void onResize(int signalNum);
+
+    // Variables
+    static std::atomic<bool> pending_;
+    static std::atomic<unsigned int> width_;
+    static std::atomic<unsigned int> height_;
+    static std::atomic<unsigned long> generation_;
+    static bool installed_;
   };
 
-  // Console raster class
-  class Canvas;
-  class CanvasRaster
-  {
-    friend Canvas;
+  //Colors!
+  enum Color
+  {
+    //Acquire _rlutil_internal info where possible--
+    BLACK = _rlutil_internal::BLACK,
+    BLUE = _rlutil_internal::BLUE,
+    GREEN = _rlutil_internal::GREEN,
+    CYAN = _rlutil_internal::CYAN,
+    RED = _rlutil_internal::RED,
+    MAGENTA = _rlutil_internal::MAGENTA,
+    BROWN = _rlutil_internal::BROWN,
+    GREY = _rlutil_internal::GREY,
+    DARKGREY = _rlutil_internal::DARKGREY,
+    LIGHTBLUE = _rlutil_internal::LIGHTBLUE,
+    LIGHTGREEN = _rlutil_internal::LIGHTGREEN,
+    LIGHTCYAN = _rlutil_internal::LIGHTCYAN,
+    LIGHTRED = _rlutil_internal::LIGHTRED,
+    LIGHTMAGENTA = _rlutil_internal::LIGHTMAGENTA,
+    YELLOW = _rlutil_internal::YELLOW,
+    WHITE = _rlutil_internal::WHITE,
+
+    // Add custom values
+    //DEFAULT = _rlutil_internal::DEFAULT, // BROKEN //Added custom to the _rlutil_internal header.
+    PREVIOUS_COLOR
+  };
+
+  // A glyph is what a single cell displays. Single codepoints (including all of ASCII) are
+  // stored inline as their value, while multi-codepoint grapheme clusters are interned in
+  // the grapheme pool and referenced by index with GLYPH_INTERNED set. This keeps every cell
+  // the same size regardless of what it holds.
+  typedef uint32_t Glyph;
+  const Glyph GLYPH_EMPTY = 0;                   // Nothing drawn.
+  const Glyph GLYPH_WIDE_TAIL = 0x110000;        // Right half of a double-width glyph.
+  const Glyph GLYPH_INTERNED = 0x80000000;       // Flag for indices into the grapheme pool.
+  const Glyph GLYPH_UNKNOWN = 0x110001;          // Screen contents unknown, never matches a drawn cell.
+
+  // Box and shade glyphs that used to be hard-coded as CP437 bytes.
+  const Glyph GLYPH_SHADE_LIGHT = 0x2591;        // CP437 176
+  const Glyph GLYPH_SHADE_MEDIUM = 0x2592;       // CP437 177
+  const Glyph GLYPH_SHADE_DARK = 0x2593;         // CP437 178
+  const Glyph GLYPH_BLOCK_FULL = 0x2588;         // CP437 219
+  const Glyph GLYPH_BLOCK_LOWER = 0x2584;        // CP437 220
+  const Glyph GLYPH_BLOCK_LEFT = 0x258C;         // CP437 221
+  const Glyph GLYPH_BLOCK_RIGHT = 0x2590;        // CP437 222
+  const Glyph GLYPH_BLOCK_UPPER = 0x2580;        // CP437 223
+
+  // Braille patterns hold a 2x4 grid of dots. OR the bits from BrailleDot onto this to draw them.
+  const Glyph GLYPH_BRAILLE = 0x2800;            // Blank braille pattern
+
+  // Interns grapheme clusters so cells can reference them by a fixed size index.
+  // Entries are never removed, so an index stays valid for the life of the program.
+  class GraphemePool
+  {
+  public:
+    // Static member functions
+    static Glyph Intern(const char *utf8, size_t len);
+    static const char *Bytes(Glyph glyph, size_t &len);
+    static unsigned int Width(Glyph glyph);
+    static size_t Count();
+
+  private:
+    // An interned cluster lives in the arena at [Offset, Offset + Length).
+    struct Entry
+    {
+      uint32_t Offset;
+      uint16_t Length;
+      uint16_t Width;
+    };
+
+    // Variables
+    static std::string arena_;
+    static std::vector<Entry> entries_;
+    static std::unordered_map<std::string, Glyph> lookup_;
+  };
+
+  // Glyph utilities
+  unsigned int CodepointWidth(uint32_t codepoint);
+  unsigned int GlyphWidth(Glyph glyph);
+  Glyph Cp437ToGlyph(unsigned char value);
+  size_t DecodeGlyph(const char *utf8, size_t len, Glyph &out);
+  void AppendGlyph(std::string &out, Glyph glyph);
+  uint8_t BrailleDot(unsigned int column, unsigned int row);
+
+  // The raster info struct, holds info on what is to be drawn at a location and the color.
+  struct RasterInfo
+  {
+    RasterInfo();
+    RasterInfo(const char val, Color col);
+    RasterInfo(Glyph val, Color col);
+    bool operator ==(const RasterInfo &rhs) const;
+    bool operator !=(const RasterInfo &rhs) const;
+    Glyph Value;
+    Color C;
+  };
+
+  // The smallest rectangle of cells holding anything but the background glyph. Empty cells
+  // count as background when the background is a space, since that's how they show.
+  CellRect ContentBounds(Field2DView<const RasterInfo> cells, Glyph background = ' ');
+
+  namespace _bounds_internal
+  {
+    size_t firstContent(const RasterInfo *cells, size_t count, Glyph background);
+    size_t lastContent(const RasterInfo *cells, size_t count, Glyph background);
+  }
+
+  // Summary of a single row of a raster. The hash covers every cell in the row and is kept
+  // up to date as cells are written, and the dirty span covers every cell that isn't empty.
+  struct RasterRow
+  {
+    RasterRow();
+    bool operator ==(const RasterRow &rhs) const;
+    bool operator !=(const RasterRow &rhs) const;
+    uint64_t Hash;
+    unsigned int DirtyStart;
+    unsigned int DirtyEnd;
+  };
+
+  // Console raster class
+  class Canvas;
+  class CanvasRaster
+  {
+    friend Canvas;
+
+  public:
+    // Constructors
+    CanvasRaster(unsigned int width, unsigned int height);
+
+    // Method Prototypes
+    bool WriteChar(char toDraw, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
+    bool WriteGlyph(Glyph toDraw, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
+    bool WriteString(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
+    bool WriteCells(const RasterInfo *cells, unsigned int count, unsigned int x, unsigned int y);
+    unsigned int WriteSpan(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
+    const Field2D<RasterInfo>& GetRasterData() const;
+    void Fill(const RasterInfo &ri);
+    void Zero();
+    void Fill(const RasterInfo &ri, unsigned int x, unsigned int y, unsigned int w, unsigned int h);
+    void Resize(unsigned int width, unsigned int height, bool preserve = false);
+
+    // General
+    unsigned int GetRasterWidth() const;
+    unsigned int GetRasterHeight() const;
+    const RasterRow &GetRow(unsigned int y) const;
+
+  private:
+    // Private member functions
+    Field2D<RasterInfo>& GetRasterData();
+    void setCell(unsigned int x, unsigned int y, const RasterInfo &ri);
+    void rehashRow(unsigned int y);
+    static uint64_t hashCell(unsigned int x, const RasterInfo &ri);
+
+    // Variables
+    unsigned int width_;
+    unsigned int height_;
+    Field2D<RasterInfo> data_;
+    std::vector<RasterRow> rows_;
+
+  };
+
+  // A small persistent pool of threads for splitting up per-frame work.
+  // The calling thread takes part in the work, and Run returns once every task is done.
+  class WorkerPool
+  {
+  public:
+    // Static member functions
+    static WorkerPool &Instance();
+
+    // Member functions
+    void Run(unsigned int taskCount, const std::function<void(unsigned int)> &task);
+    unsigned int ThreadCount() const;
+    ~WorkerPool();
+
+  private:
+    // Hidden Constructors
+    WorkerPool();
+    WorkerPool(const WorkerPool &rhs);
+    WorkerPool &operator=(const WorkerPool &rhs);
+
+    // Private methods.
+    void workerLoop();
+    void runTasks(const std::function<void(unsigned int)> &task, unsigned int taskCount);
+
+    // Variables
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(unsigned int)> *task_;
+    unsigned int taskCount_;
+    std::atomic<unsigned int> nextTask_;
+    unsigned int remaining_;
+    unsigned int active_;
+    unsigned long generation_;
+    bool stopping_;
+  };
+
+  // A run of cells along a row that changed in a frame. Cells points into the canvas, so it is
+  // only good for as long as the observer is being called.
+  struct FrameSpan
+  {
+    unsigned int X;
+    unsigned int Y;
+    unsigned int Length;
+    const RasterInfo *Cells;
+  };
+
+  // Formats a raster can be exported in.
+  enum ExportFormat
+  {
+    EXPORT_ANSI,        // Glyphs with ANSI color sequences, for terminals and logs.
+    EXPORT_TEXT,        // Glyphs only.
+    EXPORT_HTML         // A <pre> block with a <span> per run of one color.
+  };
+
+  // Turns rasters into text. Everything is appended to a single buffer, and color changes are
+  // only written where a run of one color ends, so exporting is one pass with no per-cell
+  // writes. Empty cells come out as spaces, and each row ends in a newline.
+  class RasterExporter
+  {
+  public:
+    // Static member functions
+    static void Export(std::string &out, Field2DView<const RasterInfo> raster, ExportFormat format);
+    static Field2DView<const RasterInfo> Crop(Field2DView<const RasterInfo> raster, Glyph toTrim);
+
+  private:
+    // Private methods.
+    static void appendHtmlGlyph(std::string &out, Glyph glyph);
+    static const char *htmlColor(Color color);
+  };
+
+  // Gets told about every frame a canvas puts on screen, after it is written out. Spans cover
+  // every cell that differs from the previous frame- empty cells in them are blank on screen.
+  // The whole frame is available through the canvas's raster view while being called.
+  class FrameObserver
+  {
+  public:
+    virtual ~FrameObserver() {  }
+    virtual void OnFrame(const Canvas &canvas, const FrameSpan *spans, size_t count) = 0;
+  };
+
+  // Draw commands recorded by one thread and drawn onto a canvas by whichever thread calls its
+  // Update, so workers can each draw a panel without locking the canvas or each other. Commands
+  // are recorded until Commit hands them over, which never blocks. Every Update draws the last
+  // batch committed, so a worker that is still busy leaves its last frame up; commit an empty
+  // batch to clear it. Text is kept as UTF-8 and decoded at Update, since interning grapheme
+  // clusters isn't thread safe- blitted cells shouldn't hold clusters interned off that thread.
+  class DrawBuffer
+  {
+  public:
+    // Constructor
+    DrawBuffer();
+
+    // Recording, from the thread that owns the buffer.
+    void DrawGlyph(Glyph toWrite, int x, int y, Color color = PREVIOUS_COLOR);
+    void DrawString(const char *toDraw, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+    void DrawString(const std::string &toDraw, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+    void DrawSpan(const char *toDraw, size_t len, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+    void DrawRun(Glyph toWrite, int xStart, int yStart, int length, Color color = PREVIOUS_COLOR);
+    void DrawCells(const RasterInfo *cells, unsigned int count, int xStart, int yStart);
+    void Blit(Field2DView<const RasterInfo> source, int x, int y);
+    void Commit();
+    void Discard();
+
+  private:
+    // Kinds of recorded commands.
+    enum CommandType
+    {
+      COMMAND_GLYPH,
+      COMMAND_SPAN,
+      COMMAND_RUN,
+      COMMAND_CELLS,
+      COMMAND_BLIT
+    };
+
+    // A recorded command. Text and cells live in the batch, starting at Offset.
+    struct Command
+    {
+      CommandType Type;
+      int X;
+      int Y;
+      unsigned int Width;
+      unsigned int Height;
+      Glyph Value;
+      Color C;
+      size_t Offset;
+    };
+
+    // Everything recorded between two commits.
+    struct Batch
+    {
+      std::vector<Command> Commands;
+      std::string Text;
+      std::vector<RasterInfo> Cells;
+    };
+
+    // Hidden Constructors
+    DrawBuffer(const DrawBuffer &rhs);
+    DrawBuffer &operator=(const DrawBuffer &rhs);
+
+    // Private methods.
+    void record(CommandType type, int x, int y, unsigned int width, unsigned int height, Glyph value, Color color, size_t offset);
+    void apply(Canvas &canvas);
+    friend Canvas;
+
+    // Batches are triple buffered: the owning thread records into back_, Update draws front_, and
+    // they trade through middle_, which holds a batch index with FreshBit set while it's unread.
+    static const unsigned int FreshBit = 4;
+    Batch batches_[3];
+    unsigned int back_;
+    unsigned int front_;
+    std::atomic<unsigned int> middle_;
+  };
+
+  class Canvas
+  {
+  public:
+    // Constructor
+    Canvas(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT, int xOffset = 0, int yOffset = 0);
+
+    // Init call
+    void ReInit(unsigned int width, unsigned int height, int xOffset = 0, int yOffset = 0);
+
+    // Basic drawing calls
+    bool Update();
+    void FillCanvas(const RasterInfo &ri = RasterInfo(' ', WHITE));
+    void Draw(char toWrite, int x, int y, Color color = PREVIOUS_COLOR);
+    void Draw(char toWrite, float x, float y, Color color = PREVIOUS_COLOR);
+    void DrawGlyph(Glyph toWrite, int x, int y, Color color = PREVIOUS_COLOR);
+    void DrawString(const char* toDraw, int xStart, int yStart, Color color);
+	  void DrawString(const char* toDraw, float xStart, float yStart, Color color = PREVIOUS_COLOR);
+    void DrawString(const std::string &toDraw, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+#ifdef RConsole_HAS_STRING_VIEW
+    void DrawString(std::string_view toDraw, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+#endif
+    void DrawSpan(const char *toDraw, size_t len, int xStart, int yStart, Color color = PREVIOUS_COLOR);
+    void DrawRun(Glyph toWrite, int xStart, int yStart, int length, Color color = PREVIOUS_COLOR);
+    void DrawCells(const RasterInfo *cells, unsigned int count, int xStart, int yStart);
+    void DrawAlpha(int x, int y, Color color, float opacity);
+    void DrawAlpha(float x, float y, Color color, float opacity);
+    void Shutdown();
+
+    // Advanced drawing calls
+    void DrawPartialPoint(float x, float y, Color color);
+    void DrawBox(char toWrite, float x1, float y1, float x2, float y2, Color color);
+    void Blit(const Field2D<RasterInfo> &source, int x, int y);
+    void Blit(const Field2D<RasterInfo> &source, unsigned int srcX, unsigned int srcY, unsigned int srcWidth, unsigned int srcHeight, int x, int y);
+    void Blit(Field2DView<const RasterInfo> source, int x, int y);
+    void DumpRaster(FILE *fp = stdout, ExportFormat format = EXPORT_ANSI);
+    void CropRaster(FILE *fp = stdout, char toTrim = ' ', ExportFormat format = EXPORT_ANSI);
+    void Export(std::string &out, ExportFormat format = EXPORT_ANSI) const;
+    void ExportCropped(std::string &out, char toTrim = ' ', ExportFormat format = EXPORT_ANSI) const;
+    CellRect ContentBounds(char toTrim = ' ') const;
+
+    // Data related calls
+    unsigned int GetConsoleWidht();
+    unsigned int GetConsoleHeight();
+    unsigned long GetMemID();
+    Field2DView<const RasterInfo> GetRasterView() const;
+
+    // Settings
+    void SetParallelThreshold(unsigned int minCells);
+    void SetAutoResize(bool followTerminal);
+    static void SetCursorVisible(bool isVisible);
+
+    // Observers
+    void AddFrameObserver(FrameObserver *observer);
+    void RemoveFrameObserver(FrameObserver *observer);
+
+    // Draw buffers
+    void AddDrawBuffer(DrawBuffer *buffer, int layer = 0);
+    void RemoveDrawBuffer(DrawBuffer *buffer);
+
+  private:
+    // Hidden Constructors
+    //Canvas(const Canvas &rhs);
+    
+    // Private methods.
+    bool writeRaster();
+    void followTerminal();
+    void encodeRows(unsigned int rowStart, unsigned int rowEnd, std::string &out) const;
+    void notifyObservers();
+    int  abs(int x);
+    size_t writeOut(const std::string &buffer, FILE *stream);
+    // Absolute value of int.
+
+    // static information
+    static void fullClear();
+
+    // Any rasters we have. Could be expanded to have two, so you could "swap" them,
+    // Although practicality of that is limited given the clearing technique.
+    CanvasRaster r_;
+    CanvasRaster prev_;
+
+    // The tabs on what was last modified. This is important, because we will only update
+    // what we care about.
+    bool isDrawing_;
+    unsigned int width_;
+    unsigned int height_;
+    unsigned long memoryId_;
+    int xOffset_;
+    int yOffset_;
+    Field2D<bool> modified_;
+
+    // Encoded output for each band of rows, kept around so frames don't reallocate.
+    std::vector<std::string> bands_;
+    unsigned int parallelMinCells_;
+
+    // Following the terminal's size.
+    bool autoResize_;
+    unsigned long terminalGeneration_;
+
+    // Frame observers, and the spans handed to them, kept around so frames don't reallocate.
+    std::vector<FrameObserver *> observers_;
+    std::vector<FrameSpan> spans_;
+
+    // Draw buffers and their layers, in the order they are drawn.
+    std::vector<std::pair<int, DrawBuffer *> > buffers_;
+
+    // Buffer for DumpRaster and CropRaster, kept around for the same reason.
+    std::string export_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  // Forward declaration of functions for later.
+  namespace RConsoleConfig
+  {
+    void AddObject(Canvas *c);
+    void RemoveObject(Canvas *c);
+    void SignalHandler(int signalNum);
+    void SetCloseHandler();
+    bool CloseRequested();
+    int WakeFd();
+    void CheckClose();
+  }
+
+  /////////////////////////
+ // Raster info object //
+////////////////////////
+//constructor, no character and just the previous color.
+  RasterInfo::RasterInfo() : Value(0), C(Color::PREVIOUS_COLOR)
+  {  }
+
+  // Non-Default constructor, specifies const character and color.
+  // Bytes outside of ASCII are read as CP437, which is what they used to display as.
+  RasterInfo::RasterInfo(const char val, Color col) : Value(Cp437ToGlyph(static_cast<unsigned char>(val))), C(col)
+  {  }
+
+  // Non-Default constructor, specifies a glyph and color.
+  RasterInfo::RasterInfo(Glyph val, Color col) : Value(val), C(col)
+  {  }
+
+  // Overloaded comparision operator that checks all fields.
+  bool RasterInfo::operator ==(const RasterInfo &rhs) const
+  {
+    if (rhs.C == C && rhs.Value == Value)
+      return true;
+    return false;
+  }
+
+  // Overloaded comparison operator that checks all fields.
+  bool RasterInfo::operator !=(const RasterInfo &rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+  // Bounding rectangle of the cells that aren't background.
+  CellRect ContentBounds(Field2DView<const RasterInfo> cells, Glyph background)
+  {
+    return _bounds_internal::scan(cells.Width(), cells.Height(),
+      [&cells, background](unsigned int y, unsigned int start, unsigned int end)
+      {
+        return start + static_cast<unsigned int>(_bounds_internal::firstContent(cells.RowData(y) + start, end - start, background));
+      },
+      [&cells, background](unsigned int y, unsigned int start, unsigned int end)
+      {
+        return start + static_cast<unsigned int>(_bounds_internal::lastContent(cells.RowData(y) + start, end - start, background));
+      });
+  }
+
+  namespace _bounds_internal
+  {
+    // Glyphs are compared four cells at a time, two to a register. Only the glyph half of each
+    // cell is looked at- colors don't matter.
+#ifdef RConsole_HAS_SSE2
+    static_assert(sizeof(RasterInfo) == 8, "Cells are scanned as a 32 bit glyph followed by a 32 bit color");
+    const int GLYPH_LANES = 0x0F0F;
+#endif
+
+    // Index of the first cell with content, or count if there isn't one.
+    size_t firstContent(const RasterInfo *cells, size_t count, Glyph background)
+    {
+      const Glyph alsoBackground = (background == ' ') ? GLYPH_EMPTY : background;
+      size_t i = 0;
+#ifdef RConsole_HAS_SSE2
+      const __m128i match = _mm_set1_epi32(static_cast<int>(background));
+      const __m128i alsoMatch = _mm_set1_epi32(static_cast<int>(alsoBackground));
+      for (; i + 4 <= count; i += 4)
+      {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i + 2));
+        const __m128i lowBlank = _mm_or_si128(_mm_cmpeq_epi32(low, match), _mm_cmpeq_epi32(low, alsoMatch));
+        const __m128i highBlank = _mm_or_si128(_mm_cmpeq_epi32(high, match), _mm_cmpeq_epi32(high, alsoMatch));
+        if ((_mm_movemask_epi8(_mm_and_si128(lowBlank, highBlank)) & GLYPH_LANES) != GLYPH_LANES)
+          break;
+      }
+#endif
+
+      for (; i < count; ++i)
+        if (cells[i].Value != background && cells[i].Value != alsoBackground)
+          return i;
+      return count;
+    }
+
+    // One past the last cell with content, or 0 if there isn't one.
+    size_t lastContent(const RasterInfo *cells, size_t count, Glyph background)
+    {
+      const Glyph alsoBackground = (background == ' ') ? GLYPH_EMPTY : background;
+      size_t i = count;
+#ifdef RConsole_HAS_SSE2
+      const __m128i match = _mm_set1_epi32(static_cast<int>(background));
+      const __m128i alsoMatch = _mm_set1_epi32(static_cast<int>(alsoBackground));
+      for (; i >= 4; i -= 4)
+      {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i - 4));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i - 2));
+        const __m128i lowBlank = _mm_or_si128(_mm_cmpeq_epi32(low, match), _mm_cmpeq_epi32(low, alsoMatch));
+        const __m128i highBlank = _mm_or_si128(_mm_cmpeq_epi32(high, match), _mm_cmpeq_epi32(high, alsoMatch));
+        if ((_mm_movemask_epi8(_mm_and_si128(lowBlank, highBlank)) & GLYPH_LANES) != GLYPH_LANES)
+          break;
+      }
+#endif
+
+      for (; i > 0; --i)
+        if (cells[i - 1].Value != background && cells[i - 1].Value != alsoBackground)
+          return i;
+      return 0;
+    }
+  }
+
+
+  ///////////////////
+ // Grapheme pool //
+///////////////////
+// Static pool initialization
+  std::string GraphemePool::arena_ = std::string();
+  std::vector<GraphemePool::Entry> GraphemePool::entries_ = std::vector<GraphemePool::Entry>();
+  std::unordered_map<std::string, Glyph> GraphemePool::lookup_ = std::unordered_map<std::string, Glyph>();
+
+  // Returns the glyph for the given UTF-8 cluster, adding it to the pool if it is new.
+  // Single codepoints don't need the pool- use DecodeGlyph to read text instead.
+  Glyph GraphemePool::Intern(const char *utf8, size_t len)
+  {
+    const std::string key(utf8, len);
+    auto found = lookup_.find(key);
+    if (found != lookup_.end())
+      return found->second;
+
+    // Width of a cluster is the width of its base codepoint.
+    uint32_t base = static_cast<unsigned char>(utf8[0]);
+    if (base >= 0x80)
+    {
+      const unsigned int count = (base >= 0xF0) ? 3 : (base >= 0xE0) ? 2 : 1;
+      base &= (0x3F >> count);
+      for (unsigned int i = 1; i <= count && i < len; ++i)
+        base = (base << 6) | (static_cast<unsigned char>(utf8[i]) & 0x3F);
+    }
+
+    Entry entry;
+    entry.Offset = static_cast<uint32_t>(arena_.size());
+    entry.Length = static_cast<uint16_t>(len);
+    entry.Width = static_cast<uint16_t>(CodepointWidth(base) == 2 ? 2 : 1);
+    arena_.append(utf8, len);
+
+    const Glyph glyph = GLYPH_INTERNED | static_cast<Glyph>(entries_.size());
+    entries_.push_back(entry);
+    lookup_[key] = glyph;
+    return glyph;
+  }
+
+  // Gets the UTF-8 bytes of an interned glyph. The pointer is only good until the next Intern.
+  // Glyphs that were never interned here, such as ones read from a file, come back as '?'.
+  const char *GraphemePool::Bytes(Glyph glyph, size_t &len)
+  {
+    const size_t index = glyph & ~GLYPH_INTERNED;
+    if (index >= entries_.size())
+    {
+      len = 1;
+      return "?";
+    }
+
+    const Entry &entry = entries_[index];
+    len = entry.Length;
+    return arena_.data() + entry.Offset;
+  }
+
+  // Gets the number of cells an interned glyph spans, 1 for glyphs that were never interned.
+  unsigned int GraphemePool::Width(Glyph glyph)
+  {
+    const size_t index = glyph & ~GLYPH_INTERNED;
+    return (index < entries_.size()) ? entries_[index].Width : 1;
+  }
+
+  // Number of clusters that have been interned so far.
+  size_t GraphemePool::Count()
+  {
+    return entries_.size();
+  }
+
+
+  /////////////////////
+ // Glyph utilities //
+/////////////////////
+// Number of cells a codepoint takes up in a terminal: 0 for combining marks and joiners,
+// 2 for East Asian wide and fullwidth ranges (and emoji), 1 otherwise.
+  unsigned int CodepointWidth(uint32_t cp)
+  {
+    if (cp < 0x300)
+      return 1;
+
+    // Combining marks, joiners and variation selectors.
+    if ((cp >= 0x0300 && cp <= 0x036F) || (cp >= 0x1AB0 && cp <= 0x1AFF) || (cp >= 0x1DC0 && cp <= 0x1DFF)
+      || (cp >= 0x200B && cp <= 0x200F) || (cp >= 0x20D0 && cp <= 0x20FF) || (cp >= 0xFE00 && cp <= 0xFE0F)
+      || (cp >= 0xFE20 && cp <= 0xFE2F) || (cp >= 0x1F3FB && cp <= 0x1F3FF) || (cp >= 0xE0100 && cp <= 0xE01EF))
+      return 0;
+
+    // Wide and fullwidth.
+    if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0x303E) || (cp >= 0x3041 && cp <= 0x33FF)
+      || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0xA000 && cp <= 0xA4CF)
+      || (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFE30 && cp <= 0xFE4F)
+      || (cp >= 0xFF00 && cp <= 0xFF60) || (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x1F300 && cp <= 0x1F64F)
+      || (cp >= 0x1F900 && cp <= 0x1F9FF) || (cp >= 0x20000 && cp <= 0x2FFFD) || (cp >= 0x30000 && cp <= 0x3FFFD))
+      return 2;
+
+    return 1;
+  }
+
+  // Number of cells a glyph takes up. Tails and empty cells are covered by something else.
+  unsigned int GlyphWidth(Glyph glyph)
+  {
+    if (glyph < 0x300)
+      return glyph == GLYPH_EMPTY ? 0 : 1;
+    if (glyph == GLYPH_WIDE_TAIL)
+      return 0;
+    if (glyph & GLYPH_INTERNED)
+      return GraphemePool::Width(glyph);
+
+    // Lone zero width codepoints are padded out to a cell when decoded.
+    return CodepointWidth(glyph) == 2 ? 2 : 1;
+  }
+
+  // Maps a CP437 byte to the glyph it displays as. ASCII is passed through.
+  Glyph Cp437ToGlyph(unsigned char value)
+  {
+    static const uint16_t upper[128] = {
+      0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+      0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+      0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+      0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+      0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+      0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+      0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+      0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+    };
+
+    if (value < 0x80)
+      return value;
+    return upper[value - 0x80];
+  }
+
+  // Reads one grapheme cluster from a UTF-8 string, returning how many bytes it used.
+  // A cluster is a base codepoint followed by any combining marks, variation selectors,
+  // or zero width joined codepoints, and regional indicators are paired into flags.
+  // Bytes that are not valid UTF-8 are read as CP437 so old strings keep working.
+  size_t DecodeGlyph(const char *utf8, size_t len, Glyph &out)
+  {
+    if (len == 0)
+    {
+      out = GLYPH_EMPTY;
+      return 0;
+    }
+
+    // ASCII fast path, only a following combining byte sequence can extend it.
+    const unsigned char lead = static_cast<unsigned char>(utf8[0]);
+    if (lead < 0x80 && (len == 1 || static_cast<unsigned char>(utf8[1]) < 0x80))
+    {
+      out = lead;
+      return 1;
+    }
+
+    // Decodes a single codepoint at pos, or returns 0 for invalid UTF-8. Overlong forms,
+    // surrogates and anything past U+10FFFF are invalid, so they can't land on a sentinel glyph.
+    auto decodeOne = [utf8, len](size_t pos, uint32_t &cp) -> size_t
+    {
+      const unsigned char c = static_cast<unsigned char>(utf8[pos]);
+      size_t count = 0;
+      if (c < 0x80) { cp = c; return 1; }
+      else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; count = 2; }
+      else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; count = 3; }
+      else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; count = 4; }
+      else return 0;
+
+      if (pos + count > len)
+        return 0;
+      for (size_t i = 1; i < count; ++i)
+      {
+        const unsigned char next = static_cast<unsigned char>(utf8[pos + i]);
+        if ((next & 0xC0) != 0x80)
+          return 0;
+        cp = (cp << 6) | (next & 0x3F);
+      }
+
+      static const uint32_t smallest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+      if (cp < smallest[count] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return 0;
+      return count;
+    };
+
+    uint32_t base = 0;
+    size_t used = decodeOne(0, base);
+    if (used == 0)
+    {
+      out = Cp437ToGlyph(lead);
+      return 1;
+    }
+
+    // Extend the cluster.
+    const bool isRegional = base >= 0x1F1E6 && base <= 0x1F1FF;
+    bool joinNext = false;
+    bool extended = false;
+    while (used < len)
+    {
+      uint32_t cp = 0;
+      const size_t next = decodeOne(used, cp);
+      if (next == 0)
+        break;
+
+      const bool pairsFlag = isRegional && !extended && cp >= 0x1F1E6 && cp <= 0x1F1FF;
+      if (!joinNext && !pairsFlag && CodepointWidth(cp) != 0)
+        break;
+
+      joinNext = (cp == 0x200D);
+      extended = true;
+      used += next;
+    }
+
+    // Lone combining marks are given a space to sit on so they still take up a cell.
+    if (CodepointWidth(base) == 0)
+    {
+      std::string padded(" ");
+      padded.append(utf8, used);
+      out = GraphemePool::Intern(padded.data(), padded.size());
+      return used;
+    }
+
+    out = extended ? GraphemePool::Intern(utf8, used) : base;
+    return used;
+  }
+
+  // Appends the UTF-8 encoding of a glyph to the string. Tails append nothing, since the
+  // glyph to their left covers them, and empty cells are written as a space.
+  void AppendGlyph(std::string &out, Glyph glyph)
+  {
+    if (glyph < 0x80)
+    {
+      out += (glyph == GLYPH_EMPTY) ? ' ' : static_cast<char>(glyph);
+      return;
+    }
+    if (glyph == GLYPH_WIDE_TAIL)
+      return;
+    if (glyph & GLYPH_INTERNED)
+    {
+      size_t len = 0;
+      const char *bytes = GraphemePool::Bytes(glyph, len);
+      out.append(bytes, len);
+      return;
+    }
+
+    if (glyph < 0x800)
+    {
+      out += static_cast<char>(0xC0 | (glyph >> 6));
+    }
+    else if (glyph < 0x10000)
+    {
+      out += static_cast<char>(0xE0 | (glyph >> 12));
+      out += static_cast<char>(0x80 | ((glyph >> 6) & 0x3F));
+    }
+    else
+    {
+      out += static_cast<char>(0xF0 | (glyph >> 18));
+      out += static_cast<char>(0x80 | ((glyph >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((glyph >> 6) & 0x3F));
+    }
+    out += static_cast<char>(0x80 | (glyph & 0x3F));
+  }
+
+  // The bit for the braille dot at column (0-1) and row (0-3) of a cell. Dots are numbered
+  // down the left column and then the right, with the bottom row tacked on at the end.
+  uint8_t BrailleDot(unsigned int column, unsigned int row)
+  {
+    if (row == 3)
+      return static_cast<uint8_t>(column ? 0x80 : 0x40);
+    return static_cast<uint8_t>((column ? 0x08 : 0x01) << row);
+  }
+
+
+  ////////////////
+ // Raster row //
+////////////////
+// Constructor, an empty row with nothing dirty.
+  RasterRow::RasterRow() : Hash(0), DirtyStart(0), DirtyEnd(0)
+  {  }
+
+  // Rows match if their hashes and dirty spans do.
+  bool RasterRow::operator ==(const RasterRow &rhs) const
+  {
+    return Hash == rhs.Hash && DirtyStart == rhs.DirtyStart && DirtyEnd == rhs.DirtyEnd;
+  }
+
+  // Overloaded comparison operator that checks all fields.
+  bool RasterRow::operator !=(const RasterRow &rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+
+  ///////////////////////////
+ // Console Raster object //
+///////////////////////////
+// Default constructor for the CanvasRaster- Zeros data and gets width and height.
+  CanvasRaster::CanvasRaster(unsigned int width, unsigned int height)
+    : width_(width)
+    , height_(height)
+    , data_(width, height, RasterInfo(' ', RConsole::WHITE))
+    , rows_(height)
+  {
+    for (unsigned int y = 0; y < height_; ++y)
+      rehashRow(y);
+  }
+
+  // Draws a character to the screen. Returns if it was successful or not. Goes through
+  // WriteGlyph so a wide glyph it lands on is cleared the same way as for any other write.
+  bool CanvasRaster::WriteChar(char toDraw, unsigned int x, unsigned int y, Color color)
+  {
+    return WriteGlyph(RasterInfo(toDraw, color).Value, x, y, color);
+  }
+
+  // Draws a glyph to the raster, including the tail cell of double-width glyphs.
+  // Wide glyphs that would be cut in half by something written over them are replaced with
+  // a space so the terminal doesn't end up with half a glyph. Returns if it was successful.
+  bool CanvasRaster::WriteGlyph(Glyph toDraw, unsigned int x, unsigned int y, Color color)
+  {
+    const unsigned int width = GlyphWidth(toDraw);
+    if (x + width > width_)
+      return false;
+
+    // Overwriting the tail of a wide glyph to our left.
+    if (x > 0 && data_.Peek(x, y).Value == GLYPH_WIDE_TAIL)
+      setCell(x - 1, y, RasterInfo(' ', data_.Peek(x - 1, y).C));
+
+    // Overwriting the lead of a wide glyph that extends to our right.
+    const unsigned int end = x + (width > 0 ? width : 1);
+    if (end < width_ && data_.Peek(end, y).Value == GLYPH_WIDE_TAIL)
+      setCell(end, y, RasterInfo(' ', data_.Peek(end, y).C));
+
+    setCell(x, y, RasterInfo(toDraw, color));
+    if (width == 2)
+      setCell(x + 1, y, RasterInfo(GLYPH_WIDE_TAIL, color));
+
+    return true;
+  }
+
+  // Writes a UTF-8 string to the field, stopping at the end of the row.
+  bool CanvasRaster::WriteString(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color)
+  {
+    if (x >= width_ || y >= height_)
+      return false;
+
+    WriteSpan(toWrite, len, x, y, color);
+
+    //Return success.
+    return true;
+  }
+
+  // Writes a UTF-8 string to a row, clipped at the end of the row, and returns how many cells
+  // it covered. Text is decoded into batches of cells that are copied in with WriteCells, with
+  // runs of ASCII converted directly. A wide glyph that would hang off the end becomes a space.
+  unsigned int CanvasRaster::WriteSpan(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color)
+  {
+    if (x >= width_ || y >= height_)
+      return 0;
+
+    const unsigned int batchSize = 128;
+    RasterInfo batch[batchSize];
+    const unsigned int start = x;
+    size_t read = 0;
+
+    while (read < len && x < width_)
+    {
+      const unsigned int room = (width_ - x < batchSize) ? width_ - x : batchSize;
+      unsigned int count = 0;
+
+      while (count < room && read < len)
+      {
+        const unsigned char byte = static_cast<unsigned char>(toWrite[read]);
+        if (byte < 0x80 && (read + 1 == len || static_cast<unsigned char>(toWrite[read + 1]) < 0x80))
+        {
+          batch[count++] = RasterInfo(static_cast<Glyph>(byte), color);
+          ++read;
+          continue;
+        }
+
+        Glyph glyph = GLYPH_EMPTY;
+        const size_t used = DecodeGlyph(toWrite + read, len - read, glyph);
+        if (GlyphWidth(glyph) == 2)
+        {
+          // Leave it for the next batch if only the batch is out of room.
+          if (count + 2 > room)
+          {
+            if (room == width_ - x)
+            {
+              batch[count++] = RasterInfo(' ', color);
+              read = len;
+            }
+            break;
+          }
+          batch[count++] = RasterInfo(glyph, color);
+          batch[count++] = RasterInfo(GLYPH_WIDE_TAIL, color);
+        }
+        else
+        {
+          batch[count++] = RasterInfo(glyph, color);
+        }
+        read += used;
+      }
+
+      WriteCells(batch, count, x, y);
+      x += count;
+    }
+
+    return x - start;
+  }
+
+  // Copies a run of cells into a row in one go, clipping it at the end of the row.
+  // Every cell is written, including empty ones- transparency is up to the caller.
+  // Wide glyphs that end up cut in half at either end of the run are replaced with spaces.
+  bool CanvasRaster::WriteCells(const RasterInfo *cells, unsigned int count, unsigned int x, unsigned int y)
+  {
+    if (x >= width_ || y >= height_)
+      return false;
+    if (count > width_ - x)
+      count = width_ - x;
+    if (count == 0)
+      return true;
+
+    // Wide glyphs in the raster that the run starts or ends halfway through.
+    if (x > 0 && data_.Peek(x, y).Value == GLYPH_WIDE_TAIL)
+      setCell(x - 1, y, RasterInfo(' ', data_.Peek(x - 1, y).C));
+    if (x + count < width_ && data_.Peek(x + count, y).Value == GLYPH_WIDE_TAIL)
+      setCell(x + count, y, RasterInfo(' ', data_.Peek(x + count, y).C));
+
+    // Swap the old cells' share of the hash for the new ones, then move the whole run.
+    RasterInfo *dest = &data_.Get(x, y);
+    RasterRow &row = rows_[y];
+    uint64_t hash = row.Hash;
+    for (unsigned int i = 0; i < count; ++i)
+      hash += hashCell(x + i, cells[i]) - hashCell(x + i, dest[i]);
+    memcpy(dest, cells, count * sizeof(RasterInfo));
+    row.Hash = hash;
+
+    if (row.DirtyStart == row.DirtyEnd)
+    {
+      row.DirtyStart = x;
+      row.DirtyEnd = x + count;
+    }
+    else
+    {
+      if (x < row.DirtyStart)
+        row.DirtyStart = x;
+      if (x + count > row.DirtyEnd)
+        row.DirtyEnd = x + count;
+    }
+
+    // Wide glyphs in the run that were cut in half by where it starts or ends.
+    if (dest[0].Value == GLYPH_WIDE_TAIL)
+      setCell(x, y, RasterInfo(' ', dest[0].C));
+    if (GlyphWidth(dest[count - 1].Value) == 2)
+      setCell(x + count - 1, y, RasterInfo(' ', dest[count - 1].C));
+
+    return true;
+  }
+
+  // Writes a mass of spaces to the screen.
+  void CanvasRaster::Fill(const RasterInfo &ri)
+  {
+    data_.Fill(ri);
+    for (unsigned int y = 0; y < height_; ++y)
+      rehashRow(y);
+  }
+
+  // Fills a rectangle of the raster, clipped to the raster.
+  void CanvasRaster::Fill(const RasterInfo &ri, unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+  {
+    if (x >= width_ || y >= height_)
+      return;
+    if (w > width_ - x) w = width_ - x;
+    if (h > height_ - y) h = height_ - y;
+
+    data_.FillRect(x, y, w, h, ri);
+    for (unsigned int j = y; j < y + h; ++j)
+      rehashRow(j);
+  }
+
+  // Clears out all of the data written to the raster. Does NOT move cursor to 0,0.
+  void CanvasRaster::Zero()
+  {
+    data_.Zero();
+    for (unsigned int y = 0; y < height_; ++y)
+      rows_[y] = RasterRow();
+  }
+
+  // Resizes the raster in place. Cells that aren't preserved from before are set to white
+  // spaces, the same as a newly constructed raster.
+  void CanvasRaster::Resize(unsigned int width, unsigned int height, bool preserve)
+  {
+    if (width == width_ && height == height_)
+      return;
+
+    const unsigned int oldWidth = width_;
+    const unsigned int oldHeight = height_;
+    data_.Resize(width, height, preserve);
+    rows_.resize(height);
+    width_ = width;
+    height_ = height;
+
+    if (!preserve)
+      return Fill(RasterInfo(' ', RConsole::WHITE));
+
+    const RasterInfo blank(' ', RConsole::WHITE);
+    if (width > oldWidth)
+      data_.FillRect(oldWidth, 0, width - oldWidth, (height < oldHeight) ? height : oldHeight, blank);
+    if (height > oldHeight)
+      data_.FillRect(0, oldHeight, width, height - oldHeight, blank);
+    for (unsigned int y = 0; y < height_; ++y)
+      rehashRow(y);
+  }
+
+  // Gets the hash and dirty span of a row.
+  const RasterRow &CanvasRaster::GetRow(unsigned int y) const
+  {
+    return rows_[y];
+  }
+
+  // Writes a single cell, swapping its old contribution to the row hash for the new one
+  // and growing the dirty span to cover it.
+  void CanvasRaster::setCell(unsigned int x, unsigned int y, const RasterInfo &ri)
+  {
+    data_.GoTo(x, y);
+    RasterRow &row = rows_[y];
+    row.Hash += hashCell(x, ri) - hashCell(x, data_.Get());
+    data_.Set(ri);
+
+    if (ri.Value == GLYPH_EMPTY)
+      return;
+    if (row.DirtyStart == row.DirtyEnd)
+    {
+      row.DirtyStart = x;
+      row.DirtyEnd = x + 1;
+    }
+    else if (x < row.DirtyStart)
+      row.DirtyStart = x;
+    else if (x >= row.DirtyEnd)
+      row.DirtyEnd = x + 1;
+  }
+
+  // Rebuilds the hash and dirty span of a row from scratch.
+  void CanvasRaster::rehashRow(unsigned int y)
+  {
+    // The dirty span is found by scanning in from both ends, and only cells inside it are hashed.
+    RasterRow row;
+    const RasterInfo *cells = data_.Row(y);
+    const unsigned int start = static_cast<unsigned int>(_bounds_internal::firstContent(cells, width_, GLYPH_EMPTY));
+    if (start < width_)
+    {
+      row.DirtyStart = start;
+      row.DirtyEnd = start + static_cast<unsigned int>(_bounds_internal::lastContent(cells + start, width_ - start, GLYPH_EMPTY));
+      for (unsigned int x = row.DirtyStart; x < row.DirtyEnd; ++x)
+        row.Hash += hashCell(x, cells[x]);
+    }
+    rows_[y] = row;
+  }
+
+  // Mixes a cell and its column into 64 bits (splitmix64 finalizer). Row hashes are the sum
+  // of their cells, so a write can update them without looking at the rest of the row.
+  // Empty cells hash to zero no matter their color, which keeps a zeroed row's hash at zero.
+  uint64_t CanvasRaster::hashCell(unsigned int x, const RasterInfo &ri)
+  {
+    if (ri.Value == GLYPH_EMPTY)
+      return 0;
+
+    uint64_t h = (static_cast<uint64_t>(ri.Value) | (static_cast<uint64_t>(ri.C) << 32)) + 0x9E3779B97F4A7C15ull * (x + 1);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+  }
+
+  // Get a constant reference to the existing raster.
+  const Field2D<RasterInfo>& CanvasRaster::GetRasterData() const
+  {
+    return data_;
+  }
+
+  // Underlying raster exposing.
+  Field2D<RasterInfo>& CanvasRaster::GetRasterData()
+  {
+    return data_;
+  }
+
+  // Gets console width.
+  unsigned int CanvasRaster::GetRasterWidth() const
+  {
+    return width_;
+  }
+
+  // Get console height
+  unsigned int CanvasRaster::GetRasterHeight() const
+  {
+    return height_;
+  }
+
+  // Constructor
+  Canvas::Canvas(unsigned int width, unsigned int height, int xOffset, int yOffset)
+    : r_(CanvasRaster(width, height))
+    , prev_(CanvasRaster(width, height))
+    , isDrawing_(true)
+    , width_(width)
+    , height_(height)
+    , memoryId_(reinterpret_cast<unsigned long>(this))
+    , xOffset_(xOffset)
+    , yOffset_(yOffset)
+    , modified_(Field2D<bool>(width, height))
+    , bands_(1)
+    , parallelMinCells_(RConsole_PARALLEL_MIN_CELLS)
+    , autoResize_(false)
+    , terminalGeneration_(0)
+  {
+#ifdef OS_WINDOWS
+    // Glyphs are written out as UTF-8, and frames are encoded as ANSI sequences.
+    SetConsoleOutputCP(CP_UTF8);
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(console, &mode))
+      SetConsoleMode(console, mode | 0x0004); // ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#endif
+    RConsoleConfig::AddObject(this);
+  }
+
+  /////////////////////////////
+ // Public Member Functions //
+/////////////////////////////
+// Setup with width and height. Can be re-init
+  void Canvas::ReInit(unsigned int width, unsigned int height, int xOffset, int yOffset)
+  {
+    width_ = width;
+    height_ = height;
+    xOffset_ = xOffset;
+    yOffset_ = yOffset;
+
+    // Resizing skips rasters that are already the right size, so those are blanked here instead.
+    // Either way the canvas starts over as if newly constructed at its new offset.
+    if (r_.GetRasterWidth() == width && r_.GetRasterHeight() == height)
+    {
+      r_.Fill(RasterInfo(' ', RConsole::WHITE));
+      prev_.Fill(RasterInfo(' ', RConsole::WHITE));
+    }
+    else
+    {
+      r_.Resize(width, height);
+      prev_.Resize(width, height);
+    }
+    modified_.Resize(width, height);
+    modified_.Zero();
+  }
+
+  // Clear out the screen that the user sees.
+  // Note: More expensive than clearing just the previous spaces
+  // but less expensive than clearing entire buffer with command.
+  void Canvas::FillCanvas(const RasterInfo &ri)
+  {
+    r_.Fill(ri);
+  }
+
+  // Alternate interpretation
+  void Canvas::Draw(char toWrite, float x, float y, Color color)
+  {
+    Draw(toWrite, static_cast<int>(x), static_cast<int>(y), color);
+  }
+
+  // Write the specific character in a specific color to a specific location on the console.
+  void Canvas::Draw(char toWrite, int x, int y, Color color)
+  {
+    if (x < 0) return;
+    if (y < 0) return;
+    if (static_cast<unsigned int>(x) >= width_) return;
+    if (static_cast<unsigned int>(y) >= height_) return;
+
+    modified_.GoTo(static_cast<int>(x), static_cast<int>(y));
+    modified_.Set(true);
+    r_.WriteChar(toWrite, x, y, color);
+  }
+
+  // Write a glyph, which may be a double-width or multi-codepoint one, to the console.
+  // Wide glyphs that don't fit at the right edge are drawn as a space instead.
+  void Canvas::DrawGlyph(Glyph toWrite, int x, int y, Color color)
+  {
+    if (x < 0) return;
+    if (y < 0) return;
+    if (static_cast<unsigned int>(x) >= width_) return;
+    if (static_cast<unsigned int>(y) >= height_) return;
+
+    unsigned int width = GlyphWidth(toWrite);
+    if (x + width > width_)
+    {
+      toWrite = ' ';
+      width = 1;
+    }
+
+    modified_.GoTo(static_cast<int>(x), static_cast<int>(y));
+    for (unsigned int i = 0; i < width; ++i)
+    {
+      modified_.Set(true);
+      modified_.IncrementX();
+    }
+    r_.WriteGlyph(toWrite, x, y, color);
+  }
+
+  // Draw a string with alternate arguments
+  void Canvas::DrawString(const char* toDraw, float xStart, float yStart, Color color)
+  {
+    DrawString(toDraw, static_cast<int>(xStart), static_cast<int>(yStart), color);
+  }
+
+  // Draw a UTF-8 string at the given coordinates, clipped to the canvas.
+  void Canvas::DrawString(const char* toDraw, int xStart, int yStart, Color color)
+  {
+    DrawSpan(toDraw, strlen(toDraw), xStart, yStart, color);
+  }
+
+  // Draw a std::string at the given coordinates, clipped to the canvas.
+  void Canvas::DrawString(const std::string &toDraw, int xStart, int yStart, Color color)
+  {
+    DrawSpan(toDraw.data(), toDraw.size(), xStart, yStart, color);
+  }
+
+#ifdef RConsole_HAS_STRING_VIEW
+  // Draw a string_view at the given coordinates, clipped to the canvas.
+  void Canvas::DrawString(std::string_view toDraw, int xStart, int yStart, Color color)
+  {
+    DrawSpan(toDraw.data(), toDraw.size(), xStart, yStart, color);
+  }
+#endif
+
+  // Draw len bytes of UTF-8 at the given coordinates. The span is clipped against all four
+  // edges of the canvas, written into the raster in bulk, and marked modified in one go.
+  void Canvas::DrawSpan(const char *toDraw, size_t len, int xStart, int yStart, Color color)
+  {
+    if (len == 0) return;
+
+    // Bounds check.
+    if (yStart < 0) return;
+    if (static_cast<unsigned int>(yStart) >= height_) return;
+    if (xStart >= static_cast<int>(width_)) return;
+
+    // Clip on the left by skipping what lands before the first column. A wide glyph that
+    // straddles the edge leaves a space in the half we can see.
+    size_t read = 0;
+    bool straddled = false;
+    while (xStart < 0 && read < len)
+    {
+      Glyph glyph = GLYPH_EMPTY;
+      read += DecodeGlyph(toDraw + read, len - read, glyph);
+      xStart += GlyphWidth(glyph);
+      straddled = (xStart > 0);
+    }
+    if (xStart < 0) return;
+    if (straddled)
+    {
+      DrawGlyph(' ', 0, yStart, color);
+      if (read == len)
+        return;
+    }
+
+    const unsigned int written = r_.WriteSpan(toDraw + read, len - read, xStart, yStart, color);
+    memset(&modified_.Get(xStart, yStart), true, written);
+  }
+
+  // Draw the same glyph length cells in a row starting at xStart, yStart, clipped to the canvas.
+  // The run goes into the raster in batches and is marked modified in one go, so shapes and
+  // fills cost per row instead of per cell. Double-width glyphs take two cells each.
+  void Canvas::DrawRun(Glyph toWrite, int xStart, int yStart, int length, Color color)
+  {
+    if (length <= 0) return;
+
+    // Bounds check.
+    if (yStart < 0) return;
+    if (static_cast<unsigned int>(yStart) >= height_) return;
+
+    // Wide glyphs are rare enough in runs to just place one at a time.
+    if (GlyphWidth(toWrite) == 2)
+    {
+      for (int i = 0; i + 1 < length; i += 2)
+        DrawGlyph(toWrite, xStart + i, yStart, color);
+      return;
+    }
+
+    // Clip on both sides.
+    const long long end = std::min(static_cast<long long>(xStart) + length, static_cast<long long>(width_));
+    if (xStart < 0) xStart = 0;
+    if (xStart >= end) return;
+
+    const unsigned int batchSize = 128;
+    const unsigned int count = static_cast<unsigned int>(end - xStart);
+    RasterInfo batch[batchSize];
+    std::fill_n(batch, std::min(count, batchSize), RasterInfo(toWrite, color));
+    for (unsigned int done = 0; done < count; done += batchSize)
+      r_.WriteCells(batch, std::min(batchSize, count - done), xStart + done, yStart);
+
+    memset(&modified_.Get(xStart, yStart), true, count);
+  }
+
+  // Draw a run of ready-made cells at xStart, yStart, clipped to the canvas. Unlike Blit,
+  // every cell is written, empty ones included.
+  void Canvas::DrawCells(const RasterInfo *cells, unsigned int count, int xStart, int yStart)
+  {
+    // Bounds check.
+    if (yStart < 0) return;
+    if (static_cast<unsigned int>(yStart) >= height_) return;
+    if (xStart >= static_cast<int>(width_)) return;
+
+    // Clip on the left.
+    if (xStart < 0)
+    {
+      if (static_cast<unsigned int>(-xStart) >= count) return;
+      cells += -xStart;
+      count -= -xStart;
+      xStart = 0;
+    }
+    if (count > width_ - xStart) count = width_ - xStart;
+    if (count == 0) return;
+
+    r_.WriteCells(cells, count, xStart, yStart);
+    memset(&modified_.Get(xStart, yStart), true, count);
+  }
+
+  // Updates the current raster by drawing it to the screen.
+  bool Canvas::Update()
+  {
+    RConsoleConfig::CheckClose();
+    if (!isDrawing_) return false;
+
+    if (autoResize_)
+      followTerminal();
+    for (size_t i = 0; i < buffers_.size(); ++i)
+      buffers_[i].second->apply(*this);
+    writeRaster();
+    if (!observers_.empty())
+      notifyObservers();
+
+    // What we drew is now what is on screen, and the old screen becomes the next raster.
+    std::swap(r_, prev_);
+    r_.Zero();
+    modified_.Zero();
+
+    return true;
+  }
 
-  public:
-    // Constructors
-    CanvasRaster(unsigned int width, unsigned int height);
+  // Draws a point with a shade glyph to represent alpha values in 4 steps. Opacity is looked up
+  // in a table rather than walked through a chain of comparisons. For finer ramps, blending
+  // and whole heatmaps, see ShadeRamp.
+  void Canvas::DrawAlpha(int x, int y, Color color, float opacity)
+  {
+    // Shade glyphs, these used to be the CP437 alt-codes 176, 177, 178 and 219.
+    static const Glyph shades[4] = { GLYPH_SHADE_LIGHT, GLYPH_SHADE_MEDIUM, GLYPH_SHADE_DARK, GLYPH_BLOCK_FULL };
 
-    // Method Prototypes
-    bool WriteChar(char toDraw, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
-    bool WriteString(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color = PREVIOUS_COLOR);
-    const Field2D<RasterInfo>& GetRasterData() const;
-    void Fill(const RasterInfo &ri);
-    void Zero();
+    int step = 0;
+    if (opacity >= 1)
+      step = 3;
+    else if (opacity > 0)
+      step = static_cast<int>(opacity * 4);
 
-    // General
-    unsigned int GetRasterWidth() const;
-    unsigned int GetRasterHeight() const;
+    DrawGlyph(shades[step], x, y, color);
+  }
 
-  private:
-    // Private member functions
-    Field2D<RasterInfo>& GetRasterData();
+  void Canvas::DrawAlpha(float x, float y, Color color, float opacity)
+  {
+    Canvas::DrawAlpha(static_cast<int>(x), static_cast<int>(y), color, opacity);
+  }
 
-    // Variables
-    unsigned int width_;
-    unsigned int height_;
-    Field2D<RasterInfo> data_;
+  // Stops the update loop.
+  void Canvas::Shutdown()
+  {
+    isDrawing_ = false;
+  }
 
-  };
 
-  class Canvas
+  // Draws a point at sub-cell resolution as a braille dot- cells are split into 2 columns and
+  // 4 rows of dots. Dots landing in a cell that already holds braille are added to it, so
+  // several points can share a cell. For whole plots, draw a Bitmap instead.
+  void Canvas::DrawPartialPoint(float x, float y, Color color)
   {
-  public:
-    // Constructor
-    Canvas(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT, int xOffset = 0, int yOffset = 0);
+    if (x < 0 || y < 0) return;
 
-    // Init call
-    void ReInit(unsigned int width, unsigned int height, int xOffset = 0, int yOffset = 0);
+    const int cellX = static_cast<int>(x);
+    const int cellY = static_cast<int>(y);
+    if (static_cast<unsigned int>(cellX) >= width_) return;
+    if (static_cast<unsigned int>(cellY) >= height_) return;
 
-    // Basic drawing calls
-    bool Update();
-    void FillCanvas(const RasterInfo &ri = RasterInfo(' ', WHITE));
-    void Draw(char toWrite, int x, int y, Color color = PREVIOUS_COLOR);
-    void Draw(char toWrite, float x, float y, Color color = PREVIOUS_COLOR);
-    void DrawString(const char* toDraw, int xStart, int yStart, Color color);
-	  void DrawString(const char* toDraw, float xStart, float yStart, Color color = PREVIOUS_COLOR);
-    void DrawAlpha(int x, int y, Color color, float opacity);
-    void DrawAlpha(float x, float y, Color color, float opacity);
-    void Shutdown();
+    const unsigned int column = static_cast<unsigned int>((x - cellX) * 2);
+    const unsigned int row = static_cast<unsigned int>((y - cellY) * 4);
+    Glyph glyph = GLYPH_BRAILLE | BrailleDot(column, row);
 
-    // Advanced drawing calls
-    void DrawPartialPoint(float x, float y, Color color);
-    void DrawBox(char toWrite, float x1, float y1, float x2, float y2, Color color);
-    void DumpRaster(FILE *fp = stdout);
-    void CropRaster(FILE *fp = stdout, char toTrim = ' ');
+    const Glyph existing = r_.GetRasterData().Peek(cellX, cellY).Value;
+    if (existing >= GLYPH_BRAILLE && existing <= (GLYPH_BRAILLE | 0xFF))
+      glyph |= existing;
 
-    // Data related calls
-    unsigned int GetConsoleWidht();
-    unsigned int GetConsoleHeight();
-    unsigned long GetMemID();
+    DrawGlyph(glyph, cellX, cellY, color);
+  }
 
-    // Global Settings
-    static void SetCursorVisible(bool isVisible);
+  // Draws a filled box of toWrite from x1, y1 up to but not including x2, y2, one run per row.
+  // The corners can be given in either order.
+  void Canvas::DrawBox(char toWrite, float x1, float y1, float x2, float y2, Color color)
+  {
+    if (x1 > x2) std::swap(x1, x2);
+    if (y1 > y2) std::swap(y1, y2);
 
-  private:
-    // Hidden Constructors
-    //Canvas(const Canvas &rhs);
-    
-    // Private methods.
-    void clearPrevious();
-    void setColor(const Color &color);
-    bool writeRaster(CanvasRaster &r);
-    int  abs(int x);
-    int  putC(int character, FILE * stream );
-    // Absolute value of int.
+    // At this point it can be assumed that x1 and y1 and lower than x2 and y2 respectively.
+    const int left = static_cast<int>(x1);
+    int right = static_cast<int>(x2);
+    if (right < x2) ++right;
+    int top = static_cast<int>(y1);
+    int bottom = static_cast<int>(y2);
+    if (bottom < y2) ++bottom;
+
+    // Only visit rows on the canvas.
+    if (top < 0) top = 0;
+    if (bottom > static_cast<int>(height_)) bottom = height_;
+
+    const Glyph glyph = Cp437ToGlyph(static_cast<unsigned char>(toWrite));
+    for (int y = top; y < bottom; ++y)
+      DrawRun(glyph, left, y, right - left, color);
+  }
 
-    // static information
-    static void fullClear();
+  // Copies all of a field of cells onto the canvas with its top left corner at x, y.
+  void Canvas::Blit(const Field2D<RasterInfo> &source, int x, int y)
+  {
+    Blit(source, 0, 0, source.Width(), source.Height(), x, y);
+  }
 
-    // Any rasters we have. Could be expanded to have two, so you could "swap" them,
-    // Although practicality of that is limited given the clearing technique.
-    CanvasRaster r_;
-    CanvasRaster prev_;
+  // Copies a rectangle of a field of cells onto the canvas with its top left corner at x, y.
+  void Canvas::Blit(const Field2D<RasterInfo> &source, unsigned int srcX, unsigned int srcY, unsigned int srcWidth, unsigned int srcHeight, int x, int y)
+  {
+    Blit(source.View(srcX, srcY, srcWidth, srcHeight), x, y);
+  }
 
-    // The tabs on what was last modified. This is important, because we will only update
-    // what we care about.
-    bool isDrawing_;
-    unsigned int width_;
-    unsigned int height_;
-    unsigned long memoryId_;
-    int xOffset_;
-    int yOffset_;
-    Field2D<bool> modified_;
-  };
-}
+  // Copies a view of cells, from a field or anywhere else, onto the canvas with its top left
+  // corner at x, y. The view is clipped against the canvas once up front, then each row is
+  // copied as runs of cells between transparent (empty) ones.
+  void Canvas::Blit(Field2DView<const RasterInfo> source, int x, int y)
+  {
+    unsigned int srcX = 0;
+    unsigned int srcY = 0;
+    unsigned int srcWidth = source.Width();
+    unsigned int srcHeight = source.Height();
+    if (source.Empty()) return;
 
+    // Clip against the canvas.
+    if (x < 0)
+    {
+      if (static_cast<unsigned int>(-x) >= srcWidth) return;
+      srcX += -x;
+      srcWidth -= -x;
+      x = 0;
+    }
+    if (y < 0)
+    {
+      if (static_cast<unsigned int>(-y) >= srcHeight) return;
+      srcY += -y;
+      srcHeight -= -y;
+      y = 0;
+    }
+    if (static_cast<unsigned int>(x) >= width_) return;
+    if (static_cast<unsigned int>(y) >= height_) return;
+    if (srcWidth > width_ - x) srcWidth = width_ - x;
+    if (srcHeight > height_ - y) srcHeight = height_ - y;
 
-  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
- // Implementation //////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    for (unsigned int row = 0; row < srcHeight; ++row)
+    {
+      const RasterInfo *cells = source.RowData(srcY + row) + srcX;
+      const unsigned int destY = y + row;
 
+      unsigned int start = 0;
+      while (start < srcWidth)
+      {
+        // Skip transparent cells, then find the end of the run of cells to copy.
+        while (start < srcWidth && cells[start].Value == GLYPH_EMPTY)
+          ++start;
+        unsigned int end = start;
+        while (end < srcWidth && cells[end].Value != GLYPH_EMPTY)
+          ++end;
+        if (start == end)
+          break;
+
+        const unsigned int destX = x + start;
+        memset(&modified_.Get(destX, destY), true, end - start);
+        r_.WriteCells(cells + start, end - start, destX, destY);
+        start = end;
+      }
+    }
+  }
 
-namespace RConsole
-{
-  // Forward declaration of functions for later.
-  namespace RConsoleConfig
+  //Set visibility of cursor to specified bool.
+  void Canvas::SetCursorVisible(bool isVisible)
   {
-    void AddObject(Canvas *c);
-    void RemoveObject(Canvas *c);
-    void SignalHandler(int signalNum);
-    void SetCloseHandler();
+    if (!isVisible)
+      _rlutil_internal::hidecursor();
+    else
+      _rlutil_internal::showcursor();
   }
 
-  /////////////////////////
- // Raster info object //
-////////////////////////
-//constructor, no character and just the previous color.
-  RasterInfo::RasterInfo() : Value(0), C(Color::PREVIOUS_COLOR)
-  {  }
+  // Gets the width of the console
+  unsigned int Canvas::GetConsoleWidht()
+  {
+    return width_;
+  }
 
-  // Non-Default constructor, specifies const character and color.
-  RasterInfo::RasterInfo(const char val, Color col) : Value(val), C(col)
-  {  }
+  // Gets the height of the console
+  unsigned int Canvas::GetConsoleHeight()
+  {
+    return height_;
+  }
 
-  // Overloaded comparision operator that checks all fields.
-  bool RasterInfo::operator ==(const RasterInfo &rhs) const
+  //////////////////////////////
+ // Private Member Functions //
+//////////////////////////////
+  int Canvas::abs(int x)
   {
-    if (rhs.C == C && rhs.Value == Value)
-      return true;
-    return false;
+    if (x < 0)
+      return -x;
+
+    return x;
   }
 
-  // Overloaded comparison operator that checks all fields.
-  bool RasterInfo::operator !=(const RasterInfo &rhs) const
+  // Explicitly clears every possible index. 
+  // This is expensive, and wipes ALL canvases! 
+  void Canvas::fullClear()
   {
-    return !(*this == rhs);
+    _rlutil_internal::cls();
   }
 
 
-  ///////////////////////////
- // Console Raster object //
-///////////////////////////
-// Default constructor for the CanvasRaster- Zeros data and gets width and height.
-  CanvasRaster::CanvasRaster(unsigned int width, unsigned int height)
-    : width_(width)
-    , height_(height)
-    , data_(width, height, RasterInfo(' ', RConsole::WHITE))
-  {  }
+  // Diff and write the raster we were attempting to write. Large canvases are split into bands
+  // of rows that are encoded in parallel, then written out in order with a single write.
+  bool Canvas::writeRaster()
+  {
+    unsigned int bandCount = 1;
+    if (width_ * height_ >= parallelMinCells_)
+    {
+      bandCount = WorkerPool::Instance().ThreadCount() + 1;
+      if (bandCount > height_ / RConsole_PARALLEL_MIN_ROWS)
+        bandCount = height_ / RConsole_PARALLEL_MIN_ROWS;
+      if (bandCount < 1)
+        bandCount = 1;
+    }
 
-  // Draws a character to the screen. Returns if it was successful or not.
-  bool CanvasRaster::WriteChar(char toDraw, unsigned int x, unsigned int y, Color color)
+    if (bands_.size() < bandCount)
+      bands_.resize(bandCount);
+
+    if (bandCount == 1)
+    {
+      encodeRows(0, height_, bands_[0]);
+    }
+    else
+    {
+      const unsigned int rowsPerBand = (height_ + bandCount - 1) / bandCount;
+      WorkerPool::Instance().Run(bandCount, [this, rowsPerBand](unsigned int band)
+      {
+        const unsigned int rowStart = band * rowsPerBand;
+        const unsigned int rowEnd = (rowStart + rowsPerBand < height_) ? rowStart + rowsPerBand : height_;
+        encodeRows(rowStart < height_ ? rowStart : height_, rowEnd, bands_[band]);
+      });
+
+      // Gather everything into the first band.
+      for (unsigned int i = 1; i < bandCount; ++i)
+        bands_[0] += bands_[i];
+    }
+
+    // Set end color to white when we're done.
+    bands_[0] += _rlutil_internal::getANSIColor(WHITE);
+    const bool written = writeOut(bands_[0], stdout) == bands_[0].size();
+    fflush(stdout);
+
+    // Return if we successfully printed the raster!
+    return written;
+  }
+
+  // Encodes every cell in rows [rowStart, rowEnd) that differs from what is on screen.
+  // Drawn cells are written as their glyph, and cells that had something last frame but
+  // weren't drawn this frame are cleared with a space. Rows with the same hash and dirty
+  // span as last frame are skipped outright, and the rest only compare cells inside their
+  // spans. The cursor position and color are tracked so locate and color sequences are
+  // only emitted when they change. Both start out unknown, which lets every band be encoded
+  // on its own and still be correct when the bands are written back to back.
+  void Canvas::encodeRows(unsigned int rowStart, unsigned int rowEnd, std::string &out) const
   {
-    data_.GoTo(static_cast<int>(x), static_cast<int>(y));
-    data_.Set(RasterInfo(toDraw, color));
+    const Field2D<RasterInfo> &curr = r_.GetRasterData();
+    const Field2D<RasterInfo> &prev = prev_.GetRasterData();
+    unsigned int cursorX = 0;
+    unsigned int cursorY = 0;
+    Color cursorColor = PREVIOUS_COLOR;
+    char locate[32];
+
+    out.clear();
+    for (unsigned int y = rowStart; y < rowEnd; ++y)
+    {
+      const RasterRow &currRow = r_.GetRow(y);
+      const RasterRow &prevRow = prev_.GetRow(y);
+      if (currRow == prevRow)
+        continue;
+
+      // Outside of both dirty spans everything is empty, so there is nothing to compare.
+      const unsigned int xStart = (currRow.DirtyStart == currRow.DirtyEnd) ? prevRow.DirtyStart
+        : (prevRow.DirtyStart == prevRow.DirtyEnd) ? currRow.DirtyStart
+        : (currRow.DirtyStart < prevRow.DirtyStart ? currRow.DirtyStart : prevRow.DirtyStart);
+      const unsigned int xEnd = currRow.DirtyEnd > prevRow.DirtyEnd ? currRow.DirtyEnd : prevRow.DirtyEnd;
+
+      const RasterInfo *currCells = curr.Row(y);
+      const RasterInfo *prevCells = prev.Row(y);
+      const bool *modifiedCells = modified_.Row(y);
+      for (unsigned int x = xStart; x < xEnd; ++x)
+      {
+        const RasterInfo &ri = currCells[x];
+        if (ri == prevCells[x])
+          continue;
+
+        // Tails are printed as part of the wide glyph to their left.
+        Glyph glyph = ri.Value;
+        Color color = ri.C;
+        if (glyph == GLYPH_WIDE_TAIL)
+          continue;
+        if (glyph == GLYPH_EMPTY)
+        {
+          if (modifiedCells[x])
+            continue;
+          glyph = ' ';
+          color = PREVIOUS_COLOR;
+        }
 
-    //Everything completed correctly.
-    return true;
+        // locate on screen and set color
+        const unsigned int xLoc = x + 1 + xOffset_;
+        const unsigned int yLoc = y + 1 + yOffset_;
+        if (xLoc != cursorX || yLoc != cursorY)
+        {
+          const int len = snprintf(locate, sizeof(locate), "\033[%u;%uH", yLoc, xLoc);
+          out.append(locate, static_cast<size_t>(len));
+          cursorY = yLoc;
+        }
+        if (color != PREVIOUS_COLOR && color != cursorColor)
+        {
+          out += _rlutil_internal::getANSIColor(color);
+          cursorColor = color;
+        }
+
+        // The terminal moves the cursor past every cell the glyph covers.
+        AppendGlyph(out, glyph);
+        cursorX = xLoc + GlyphWidth(glyph);
+      }
+    }
   }
 
-  // Writes a string to the field
-  bool CanvasRaster::WriteString(const char *toWrite, size_t len, unsigned int x, unsigned int y, Color color)
+  // Gathers the cells that changed this frame into spans and hands them to every observer.
+  // Rows are skipped and narrowed the same way encodeRows does it. Runs of changed cells with
+  // only a few unchanged ones between them are joined, since a short gap costs less to send
+  // than another span.
+  void Canvas::notifyObservers()
   {
-    //Establish and check for a string of a usable size.
-    data_.GoTo(static_cast<int>(x), static_cast<int>(y));
-    for (unsigned int i = 0; i < len; ++i)
+    const unsigned int joinGap = 4;
+    const Field2D<RasterInfo> &curr = r_.GetRasterData();
+    const Field2D<RasterInfo> &prev = prev_.GetRasterData();
+
+    spans_.clear();
+    for (unsigned int y = 0; y < height_; ++y)
     {
-      data_.Set(RasterInfo(toWrite[i], color));
-      data_.IncrementX();
+      const RasterRow &currRow = r_.GetRow(y);
+      const RasterRow &prevRow = prev_.GetRow(y);
+      if (currRow == prevRow)
+        continue;
+
+      const unsigned int xStart = (currRow.DirtyStart == currRow.DirtyEnd) ? prevRow.DirtyStart
+        : (prevRow.DirtyStart == prevRow.DirtyEnd) ? currRow.DirtyStart
+        : (currRow.DirtyStart < prevRow.DirtyStart ? currRow.DirtyStart : prevRow.DirtyStart);
+      const unsigned int xEnd = currRow.DirtyEnd > prevRow.DirtyEnd ? currRow.DirtyEnd : prevRow.DirtyEnd;
+
+      const RasterInfo *currCells = curr.Row(y);
+      const RasterInfo *prevCells = prev.Row(y);
+      bool open = false;
+      unsigned int last = 0;
+      for (unsigned int x = xStart; x < xEnd; ++x)
+      {
+        if (currCells[x] == prevCells[x])
+          continue;
+
+        if (open && x - last <= joinGap)
+        {
+          spans_.back().Length = x - spans_.back().X + 1;
+        }
+        else
+        {
+          FrameSpan span = { x, y, 1, currCells + x };
+          spans_.push_back(span);
+          open = true;
+        }
+        last = x;
+      }
     }
 
-    //Return success.
-    return true;
+    for (FrameObserver *observer : observers_)
+      observer->OnFrame(*this, spans_.data(), spans_.size());
   }
 
-  // Writes a mass of spaces to the screen.
-  void CanvasRaster::Fill(const RasterInfo &ri)
+  // Cross-platform write of a whole buffer.
+  size_t Canvas::writeOut(const std::string &buffer, FILE *stream)
   {
-    data_.Fill(ri);
+#if defined(RConsole_NO_THREADING) && defined(OS_WINDOWS)
+    return _fwrite_nolock(buffer.data(), 1, buffer.size(), stream);
+#else
+    return fwrite(buffer.data(), 1, buffer.size(), stream);
+#endif
   }
 
-  // Clears out all of the data written to the raster. Does NOT move cursor to 0,0.
-  void CanvasRaster::Zero()
+  // Sets how many cells a canvas needs before its updates are split across threads.
+  void Canvas::SetParallelThreshold(unsigned int minCells)
   {
-    data_.Zero();
+    parallelMinCells_ = minCells;
   }
 
-  // Get a constant reference to the existing raster.
-  const Field2D<RasterInfo>& CanvasRaster::GetRasterData() const
+  // Sets whether the canvas resizes itself to fill the terminal (less its offsets) whenever the
+  // terminal changes size. The resize happens in place at the start of the next Update.
+  void Canvas::SetAutoResize(bool followTerminal)
   {
-    return data_;
+    autoResize_ = followTerminal;
+    terminalGeneration_ = 0;
   }
 
-  // Underlying raster exposing.
-  Field2D<RasterInfo>& CanvasRaster::GetRasterData()
+  // Starts telling an observer about every frame. The observer has to outlive the canvas, or
+  // be removed first.
+  void Canvas::AddFrameObserver(FrameObserver *observer)
   {
-    return data_;
+    if (std::find(observers_.begin(), observers_.end(), observer) == observers_.end())
+      observers_.push_back(observer);
   }
 
-  // Gets console width.
-  unsigned int CanvasRaster::GetRasterWidth() const
+  // Stops telling an observer about frames.
+  void Canvas::RemoveFrameObserver(FrameObserver *observer)
   {
-    return width_;
+    observers_.erase(std::remove(observers_.begin(), observers_.end(), observer), observers_.end());
   }
 
-  // Get console height
-  unsigned int CanvasRaster::GetRasterHeight() const
+  // Starts drawing a buffer's commits at every Update, on top of whatever was drawn directly.
+  // Lower layers are drawn first, and buffers on the same layer in the order they were added, so
+  // overlapping panels always come out the same. Add and remove buffers from the thread that
+  // calls Update. The buffer has to outlive the canvas, or be removed first.
+  void Canvas::AddDrawBuffer(DrawBuffer *buffer, int layer)
   {
-    return height_;
+    RemoveDrawBuffer(buffer);
+    auto at = std::upper_bound(buffers_.begin(), buffers_.end(), layer,
+      [](int value, const std::pair<int, DrawBuffer *> &entry) { return value < entry.first; });
+    buffers_.insert(at, std::make_pair(layer, buffer));
   }
 
-  // Constructor
-  Canvas::Canvas(unsigned int width, unsigned int height, int xOffset, int yOffset)
-    : r_(CanvasRaster(width, height))
-    , prev_(CanvasRaster(width, height))
-    , isDrawing_(true)
-    , width_(width)
-    , height_(height)
-    , xOffset_(xOffset)
-    , yOffset_(yOffset)
-    , modified_(Field2D<bool>(width, height))
-    , memoryId_(reinterpret_cast<unsigned long>(this))
+  // Stops drawing a buffer.
+  void Canvas::RemoveDrawBuffer(DrawBuffer *buffer)
   {
-    RConsoleConfig::AddObject(this);
+    for (size_t i = 0; i < buffers_.size(); ++i)
+      if (buffers_[i].second == buffer)
+      {
+        buffers_.erase(buffers_.begin() + i);
+        return;
+      }
   }
-
-  /////////////////////////////
- // Public Member Functions //
-/////////////////////////////
-// Setup with width and height. Can be re-init
-  void Canvas::ReInit(unsigned int width, unsigned int height, int xOffset, int yOffset)
+
+  // Resizes the canvas to the terminal if the terminal changed since we last looked. What was
+  // drawn is kept, and only what the terminal can't be trusted to still show is redrawn: cells
+  // that were just exposed, or the whole canvas after a shrink, since terminals may rewrap or
+  // scroll what they were showing when they get smaller. The screen is never cleared.
+  void Canvas::followTerminal()
   {
+    const unsigned long generation = TerminalSize::Poll();
+    if (generation == terminalGeneration_)
+      return;
+    terminalGeneration_ = generation;
+
+    const int columns = static_cast<int>(TerminalSize::Width()) - 1 - xOffset_;
+    const int rows = static_cast<int>(TerminalSize::Height()) - yOffset_;
+    const unsigned int width = (columns > 0) ? columns : 1;
+    const unsigned int height = (rows > 0) ? rows : 1;
+    if (width == width_ && height == height_)
+      return;
+
+    const unsigned int oldWidth = width_;
+    const unsigned int oldHeight = height_;
     width_ = width;
     height_ = height;
-    xOffset_ = xOffset;
-    yOffset_ = yOffset;
-    r_ = CanvasRaster(width, height);
-    prev_ = CanvasRaster(width, height);
-    modified_ = Field2D<bool>(width, height);
+    r_.Resize(width, height, true);
+    prev_.Resize(width, height, true);
+    modified_.Resize(width, height, true);
+
+    // Nothing has been drawn in the new cells yet, and the screen under them is unknown.
+    const RasterInfo empty;
+    const RasterInfo unknown(GLYPH_UNKNOWN, PREVIOUS_COLOR);
+    r_.Fill(empty, oldWidth, 0, width - oldWidth, height);
+    r_.Fill(empty, 0, oldHeight, width, height - oldHeight);
+    if (width < oldWidth || height < oldHeight)
+      return prev_.Fill(unknown, 0, 0, width, height);
+
+    prev_.Fill(unknown, oldWidth, 0, width - oldWidth, oldHeight);
+    prev_.Fill(unknown, 0, oldHeight, width, height - oldHeight);
   }
 
-  // Clear out the screen that the user sees.
-  // Note: More expensive than clearing just the previous spaces
-  // but less expensive than clearing entire buffer with command.
-  void Canvas::FillCanvas(const RasterInfo &ri)
+
+  // Writes out the whole raster as it stands, in one write.
+  void Canvas::DumpRaster(FILE *fp, ExportFormat format)
   {
-    r_.Fill(ri);
+    export_.clear();
+    Export(export_, format);
+    writeOut(export_, fp);
+    fflush(fp);
   }
 
-  // Alternate interpretation
-  void Canvas::Draw(char toWrite, float x, float y, Color color)
+  // Writes out the smallest part of the raster holding everything that isn't toTrim, in one
+  // write. Nothing is written if it's all toTrim.
+  void Canvas::CropRaster(FILE *fp, char toTrim, ExportFormat format)
   {
-    Draw(toWrite, static_cast<int>(x), static_cast<int>(y), color);
+    export_.clear();
+    ExportCropped(export_, toTrim, format);
+    writeOut(export_, fp);
+    fflush(fp);
   }
 
-  // Write the specific character in a specific color to a specific location on the console.
-  void Canvas::Draw(char toWrite, int x, int y, Color color)
+  // Appends the whole raster to out.
+  void Canvas::Export(std::string &out, ExportFormat format) const
   {
-    if (x < 0) return;
-    if (y < 0) return;
-    if (static_cast<unsigned int>(x) >= width_) return;
-    if (static_cast<unsigned int>(y) >= height_) return;
-
-    modified_.GoTo(static_cast<int>(x), static_cast<int>(y));
-    modified_.Set(true);
-    r_.WriteChar(toWrite, x, y, color);
+    RasterExporter::Export(out, r_.GetRasterData().View(), format);
   }
 
-  // Draw a string with alternate arguments
-  void Canvas::DrawString(const char* toDraw, float xStart, float yStart, Color color)
+  // The smallest rectangle of the raster holding everything that isn't toTrim.
+  CellRect Canvas::ContentBounds(char toTrim) const
   {
-    DrawString(toDraw, static_cast<int>(xStart), static_cast<int>(yStart), color);
+    return RConsole::ContentBounds(r_.GetRasterData().View(), Cp437ToGlyph(static_cast<unsigned char>(toTrim)));
   }
 
-  // Draw a string at the given coordinates
-  void Canvas::DrawString(const char* toDraw, int xStart, int yStart, Color color)
+  // Appends the smallest part of the raster holding everything that isn't toTrim to out.
+  void Canvas::ExportCropped(std::string &out, char toTrim, ExportFormat format) const
   {
-    size_t len = strlen(toDraw);
-    if (len <= 0) return;
-
-    // Bounds check.
-    if (xStart < 0) return;
-    if (yStart < 0) return;
-    if (static_cast<unsigned int>(xStart) >= width_) return;
-    if (static_cast<unsigned int>(yStart) >= height_) return;
-
-    // Set the memory we are using to modified.
-    modified_.GoTo(static_cast<int>(xStart), static_cast<int>(yStart));
-    unsigned int index = modified_.GetIndex();
-    if (static_cast<unsigned int>(xStart) >= width_)
-      return;
-
-    // Checks the length and adjusts if it will be past.
-    int writeLen = len;
-    if (writeLen + index > modified_.Length())
-      writeLen = modified_.Length() - index;
+    const Glyph trimGlyph = Cp437ToGlyph(static_cast<unsigned char>(toTrim));
+    const Field2DView<const RasterInfo> crop = RasterExporter::Crop(r_.GetRasterData().View(), trimGlyph);
+    if (!crop.Empty())
+      RasterExporter::Export(out, crop, format);
+  }
 
-    // If our length plus the index we are at exceeds the end of the buffer, only write what we can.
-    memset(modified_.GetHead() + index, true, writeLen);
 
-    // Write string
-    r_.WriteString(toDraw, len, static_cast<int>(xStart), static_cast<int>(yStart), color);
+  // Returns the location in memory of the object when it was created.
+  unsigned long Canvas::GetMemID()
+  {
+    return memoryId_;
   }
 
-  // Updates the current raster by drawing it to the screen.
-  bool Canvas::Update()
+  // A read-only look at what has been drawn so far this frame.
+  Field2DView<const RasterInfo> Canvas::GetRasterView() const
   {
-    if (!isDrawing_) return false;
-
-    clearPrevious();
-    writeRaster(r_);
+    return r_.GetRasterData().View();
+  }
 
-    // Write and reset the raster.
-    memcpy(prev_.GetRasterData().GetHead(), r_.GetRasterData().GetHead(), width_ * height_ * sizeof(RasterInfo));
-    r_.Zero();
+  /////////////////
+ // Draw buffer //
+/////////////////
+// Constructor, nothing is drawn until the first commit.
+  DrawBuffer::DrawBuffer()
+    : back_(0)
+    , front_(1)
+    , middle_(2)
+  {  }
 
-    _rlutil_internal::setColor(WHITE);
+  // Records a single glyph.
+  void DrawBuffer::DrawGlyph(Glyph toWrite, int x, int y, Color color)
+  {
+    record(COMMAND_GLYPH, x, y, 0, 0, toWrite, color, 0);
+  }
 
-    return true;
+  // Records a string, drawn as a span.
+  void DrawBuffer::DrawString(const char *toDraw, int xStart, int yStart, Color color)
+  {
+    DrawSpan(toDraw, strlen(toDraw), xStart, yStart, color);
   }
 
-  // Draws a point with ASCII to attempt to represent alpha values in 4 steps.
-  // Tends to work with windows only...
-  void Canvas::DrawAlpha(int x, int y, Color color, float opacity)
+  // Records a std::string, drawn as a span.
+  void DrawBuffer::DrawString(const std::string &toDraw, int xStart, int yStart, Color color)
   {
-    // All characters use represent alt-codes. 
-    if (opacity < .25)
-      Draw(static_cast<unsigned char>(176), x, y, color);
-    else if (opacity < .5)
-      Draw(static_cast<unsigned char>(177), x, y, color);
-    else if (opacity < .75)
-      Draw(static_cast<unsigned char>(178), x, y, color);
-    else
-      Draw(static_cast<unsigned char>(219), x, y, color);
+    DrawSpan(toDraw.data(), toDraw.size(), xStart, yStart, color);
   }
 
-  void Canvas::DrawAlpha(float x, float y, Color color, float opacity)
+  // Records len bytes of UTF-8. The text is copied, so it doesn't need to outlive the call.
+  void DrawBuffer::DrawSpan(const char *toDraw, size_t len, int xStart, int yStart, Color color)
   {
-    Canvas::DrawAlpha(static_cast<int>(x), static_cast<int>(y), color, opacity);
+    Batch &batch = batches_[back_];
+    record(COMMAND_SPAN, xStart, yStart, static_cast<unsigned int>(len), 0, GLYPH_EMPTY, color, batch.Text.size());
+    batch.Text.append(toDraw, len);
   }
 
-  // Stops the update loop.
-  void Canvas::Shutdown()
+  // Records a run of the same glyph.
+  void DrawBuffer::DrawRun(Glyph toWrite, int xStart, int yStart, int length, Color color)
   {
-    isDrawing_ = false;
+    if (length <= 0) return;
+    record(COMMAND_RUN, xStart, yStart, static_cast<unsigned int>(length), 0, toWrite, color, 0);
   }
 
+  // Records a run of ready-made cells. Like Canvas::DrawCells, empty ones are drawn too.
+  void DrawBuffer::DrawCells(const RasterInfo *cells, unsigned int count, int xStart, int yStart)
+  {
+    Batch &batch = batches_[back_];
+    record(COMMAND_CELLS, xStart, yStart, count, 1, GLYPH_EMPTY, PREVIOUS_COLOR, batch.Cells.size());
+    batch.Cells.insert(batch.Cells.end(), cells, cells + count);
+  }
 
-  // Draws a point with ASCII to attempt to represent location in a square.
-  void Canvas::DrawPartialPoint(float x, float y, Color color)
+  // Records a blit. The cells are copied, so a worker can render a panel into a field of its own
+  // and hand it over in one go.
+  void DrawBuffer::Blit(Field2DView<const RasterInfo> source, int x, int y)
   {
-    // Get first two decimal places from location.
-    int xDec = static_cast<int>(x * 100) % 100;
-    int yDec = static_cast<int>(x * 100) % 100;
+    if (source.Empty()) return;
 
-    UNUSED(xDec);
-    UNUSED(yDec);
+    Batch &batch = batches_[back_];
+    record(COMMAND_BLIT, x, y, source.Width(), source.Height(), GLYPH_EMPTY, PREVIOUS_COLOR, batch.Cells.size());
+    for (unsigned int row = 0; row < source.Height(); ++row)
+      batch.Cells.insert(batch.Cells.end(), source.RowData(row), source.RowData(row) + source.Width());
+  }
 
-    //If Y is closer to a border, use it for placement.
-    if (abs(50 - static_cast<int>(x)) < abs(50 - static_cast<int>(y)))
-    {
-      if (x > 50)
-        return Draw(static_cast<unsigned char>(222), x, y, color);
-      return Draw(static_cast<unsigned char>(221), x, y, color);
-    }
-    //Otherwise, X is closer to a border.
-    else
-    {
-      if (y > 50)
-        return Draw(static_cast<unsigned char>(223), x, y, color);
-      return Draw(static_cast<unsigned char>(220), x, y, color);
-    }
+  // Hands what has been recorded to the canvas, replacing the last commit, and starts recording
+  // a new batch. A commit the canvas hasn't drawn yet is replaced without ever being drawn.
+  void DrawBuffer::Commit()
+  {
+    back_ = middle_.exchange(back_ | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+    Discard();
   }
 
-  // Drawing box
-  void Canvas::DrawBox(char toWrite, float x1, float y1, float x2, float y2, Color color)
+  // Drops what has been recorded since the last commit.
+  void DrawBuffer::Discard()
   {
+    Batch &batch = batches_[back_];
+    batch.Commands.clear();
+    batch.Text.clear();
+    batch.Cells.clear();
+  }
 
-    if (x1 > x2)
-    {
-      float temp = x1;
-      x2 = x1;
-      temp = x2;
-    }
-    if (y1 > y2)
-    {
-      float temp = y1;
-      y2 = y1;
-      temp = y2;
-    }
+  // Adds a command to the batch being recorded.
+  void DrawBuffer::record(CommandType type, int x, int y, unsigned int width, unsigned int height, Glyph value, Color color, size_t offset)
+  {
+    Command command;
+    command.Type = type;
+    command.X = x;
+    command.Y = y;
+    command.Width = width;
+    command.Height = height;
+    command.Value = value;
+    command.C = color;
+    command.Offset = offset;
+    batches_[back_].Commands.push_back(command);
+  }
 
-    // At this point it can be assumed that x1 and y1 and lower than x2 and y2 respectively.
+  // Picks up the latest commit, if there is one, and draws it. Only called by Canvas::Update.
+  void DrawBuffer::apply(Canvas &canvas)
+  {
+    if (middle_.load(std::memory_order_acquire) & FreshBit)
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & ~FreshBit;
 
-    for (unsigned int x = static_cast<unsigned int>(x1); x < x2; ++x)
+    const Batch &batch = batches_[front_];
+    for (size_t i = 0; i < batch.Commands.size(); ++i)
     {
-      for (unsigned int y = static_cast<unsigned int>(x1); y < y2; ++y)
+      const Command &command = batch.Commands[i];
+      switch (command.Type)
       {
-        Draw(toWrite, static_cast<float>(x), static_cast<float>(y), color);
+      case COMMAND_GLYPH:
+        canvas.DrawGlyph(command.Value, command.X, command.Y, command.C);
+        break;
+      case COMMAND_SPAN:
+        canvas.DrawSpan(batch.Text.data() + command.Offset, command.Width, command.X, command.Y, command.C);
+        break;
+      case COMMAND_RUN:
+        canvas.DrawRun(command.Value, command.X, command.Y, static_cast<int>(command.Width), command.C);
+        break;
+      case COMMAND_CELLS:
+        canvas.DrawCells(batch.Cells.data() + command.Offset, command.Width, command.X, command.Y);
+        break;
+      case COMMAND_BLIT:
+        canvas.Blit(Field2DView<const RasterInfo>(batch.Cells.data() + command.Offset, command.Width, command.Height, command.Width), command.X, command.Y);
+        break;
       }
     }
   }
 
-  //Set visibility of cursor to specified bool.
-  void Canvas::SetCursorVisible(bool isVisible)
+  ///////////
+ // Arena //
+///////////
+// Constructor, blocks are allocated as they are needed.
+  Arena::Arena(size_t blockSize)
+    : blocks_()
+    , current_(0)
+    , blockSize_(blockSize)
+  {  }
+
+  // Frees every block, and with it everything allocated from the arena.
+  Arena::~Arena()
   {
-    if (!isVisible)
-      _rlutil_internal::hidecursor();
-    else
-      _rlutil_internal::showcursor();
+    for (Block &block : blocks_)
+      ::operator delete(block.Memory);
   }
 
-  // Gets the width of the console
-  unsigned int Canvas::GetConsoleWidht()
+  // Carves bytes out of the current block, moving on to the next one (or a new one) if it
+  // doesn't fit. Requests bigger than the block size get a block of their own.
+  void *Arena::Allocate(size_t bytes, size_t alignment)
   {
-    return width_;
+    while (current_ < blocks_.size())
+    {
+      Block &block = blocks_[current_];
+      const uintptr_t base = reinterpret_cast<uintptr_t>(block.Memory);
+      const uintptr_t start = (base + block.Used + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+      if (start + bytes <= base + block.Size)
+      {
+        block.Used = static_cast<size_t>(start + bytes - base);
+        return reinterpret_cast<void *>(start);
+      }
+      ++current_;
+    }
+
+    Block block;
+    block.Size = (bytes + alignment > blockSize_) ? bytes + alignment : blockSize_;
+    block.Memory = static_cast<char *>(::operator new(block.Size));
+    block.Used = 0;
+    blocks_.push_back(block);
+    current_ = blocks_.size() - 1;
+    return Allocate(bytes, alignment);
   }
 
-  // Gets the height of the console
-  unsigned int Canvas::GetConsoleHeight()
+  // Marks all memory as free again without giving it back to the system. Anything still
+  // using memory from the arena must be gone before this is called.
+  void Arena::Reset()
   {
-    return height_;
+    for (Block &block : blocks_)
+      block.Used = 0;
+    current_ = 0;
   }
 
-  //////////////////////////////
- // Private Member Functions //
-//////////////////////////////
-  int Canvas::abs(int x)
+  // Total bytes handed out, including alignment padding.
+  size_t Arena::BytesUsed() const
   {
-    if (x < 0)
-      return -x;
-
-    return x;
+    size_t used = 0;
+    for (const Block &block : blocks_)
+      used += block.Used;
+    return used;
   }
 
-  // Clears out the screen based on the previous items written. Clear character is a space.
-  void Canvas::clearPrevious()
+
+  /////////////////////
+ // Raster exporter //
+/////////////////////
+// Appends a raster to out. Each row is one pass over its cells: runs of one color are gathered
+// and the color is written once at the start of each. Cells that don't show a color, like
+// empty ones and spaces, carry on whatever run they're in.
+  void RasterExporter::Export(std::string &out, Field2DView<const RasterInfo> raster, ExportFormat format)
   {
-    // Walk through, write over only what was modified.
-    modified_.SetIndex(0);
-    unsigned int maxIndex = modified_.Length();
-    unsigned int index = 0;
+    if (raster.Empty())
+      return;
 
-    while (true)
-    {
-      index = modified_.GetIndex();
-      const RasterInfo &curr = r_.GetRasterData().Peek(index);
-      const RasterInfo &prev = prev_.GetRasterData().Peek(index);
+    // Most cells are a byte, and color changes are rare, so this is usually enough.
+    out.reserve(out.size() + static_cast<size_t>(raster.Width() + 16) * raster.Height());
+
+    Color current = PREVIOUS_COLOR;
+    if (format == EXPORT_HTML)
+      out += "<pre class=\"rconsole\">";
 
-      // If we have not modified the space,
-      // and we don't have the same character as last time,
-      // and we don't have the same color.
-      if (!modified_.Get() && curr != prev)
+    for (Field2DRow<const RasterInfo> row : raster)
+    {
+      for (const RasterInfo &ri : row)
       {
-        // Compute X and Y location
-        unsigned int xLoc = (index % width_) + 1 + xOffset_;
-        unsigned int yLoc = (index / width_) + 1 + yOffset_;
+        if (ri.Value == GLYPH_WIDE_TAIL)
+          continue;
 
-        if ((yLoc > height_ + yOffset_) == false && (xLoc > width_ + xOffset_) == false)
+        if (format != EXPORT_TEXT && ri.Value != GLYPH_EMPTY && ri.Value != ' ' && ri.C != PREVIOUS_COLOR && ri.C != current)
         {
-          // locate on screen and set color
-          _rlutil_internal::locate(xLoc, yLoc);
-
-          putC(' ', stdout);
+          if (format == EXPORT_ANSI)
+          {
+            out += _rlutil_internal::getANSIColor(ri.C);
+          }
+          else
+          {
+            if (current != PREVIOUS_COLOR)
+              out += "</span>";
+            out += "<span style=\"color:";
+            out += htmlColor(ri.C);
+            out += "\">";
+          }
+          current = ri.C;
         }
-      }
-
-      if (index + 1 >= maxIndex)
-        break;
 
-      modified_.IncrementX();
+        if (format == EXPORT_HTML)
+          appendHtmlGlyph(out, ri.Value);
+        else
+          AppendGlyph(out, ri.Value);
+      }
+      out += '\n';
     }
 
-    // Set things back to zero.
-    modified_.Zero();
+    // Leave things the way they'd be after an update.
+    if (format == EXPORT_ANSI)
+    {
+      out += _rlutil_internal::getANSIColor(WHITE);
+    }
+    else if (format == EXPORT_HTML)
+    {
+      if (current != PREVIOUS_COLOR)
+        out += "</span>";
+      out += "</pre>\n";
+    }
   }
 
-
-  // Explicitly clears every possible index. 
-  // This is expensive, and wipes ALL canvases! 
-  void Canvas::fullClear()
+  // The smallest part of a raster holding every cell that isn't toTrim. Empty cells count as
+  // spaces. The view is empty if every cell is trimmed.
+  Field2DView<const RasterInfo> RasterExporter::Crop(Field2DView<const RasterInfo> raster, Glyph toTrim)
   {
-    _rlutil_internal::cls();
+    const CellRect bounds = ContentBounds(raster, toTrim);
+    if (bounds.Empty())
+      return Field2DView<const RasterInfo>();
+    return raster.SubView(bounds.X, bounds.Y, bounds.Width, bounds.Height);
   }
 
-
-  // Set the color in the console using utility, if applicable.
-  void Canvas::setColor(const Color &color)
+  // Appends a glyph with the characters HTML treats specially escaped.
+  void RasterExporter::appendHtmlGlyph(std::string &out, Glyph glyph)
   {
-    if (color != PREVIOUS_COLOR)
-      _rlutil_internal::setColor(color);
+    switch (glyph)
+    {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      default: AppendGlyph(out, glyph); break;
+    }
   }
 
-
-  // Write the raster we were attempting to write.
-  bool Canvas::writeRaster(CanvasRaster &r)
+  // The CSS color for a console color, using the classic VGA palette.
+  const char *RasterExporter::htmlColor(Color color)
   {
-    // Set initial position.
-    Field2D<RConsole::RasterInfo> &data = r.GetRasterData();
-    unsigned int maxIndex = data.Length();
-    unsigned int index = 0;
-    data.SetIndex(0);
-
-    while (true)
+    static const char *const colors[16] =
     {
-      index = data.GetIndex();
-      const RasterInfo& ri = data.Get();
+      "#000000", "#0000aa", "#00aa00", "#00aaaa", "#aa0000", "#aa00aa", "#aa5500", "#aaaaaa",
+      "#555555", "#5555ff", "#55ff55", "#55ffff", "#ff5555", "#ff55ff", "#ffff55", "#ffffff"
+    };
 
-      if (ri.Value != 0 && prev_.GetRasterData().Peek(index) != ri)
-      {
-        unsigned int xLoc = (index % width_) + 1 + xOffset_;
-        unsigned int yLoc = (index / width_) + 1 + yOffset_;
+    return (color >= 0 && color < 16) ? colors[color] : "inherit";
+  }
 
-        // Handle X
-        if ((xLoc > width_ + xOffset_) == false && (yLoc > height_ + yOffset_) == false)
-        {
-          // locate on screen and set color
-          _rlutil_internal::locate(xLoc, yLoc);
 
-          // Set color of cursor
-          setColor(ri.C);
+  ///////////////////
+ // Terminal size //
+///////////////////
+// Static initialization. Everything starts out pending so the first read queries the terminal.
+  std::atomic<bool> TerminalSize::pending_(true);
+  std::atomic<unsigned int> TerminalSize::width_(80);
+  std::atomic<unsigned int> TerminalSize::height_(24);
+  std::atomic<unsigned long> TerminalSize::generation_(0);
+  bool TerminalSize::installed_ = false;
 
-          // Print out to the console in the preferred fashion
-          int retVal = 0;
+  // Starts listening for the terminal being resized. Safe to call more than once.
+  void TerminalSize::Install()
+  {
+    if (installed_)
+      return;
+    installed_ = true;
+
+#ifdef OS_POSIX
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onResize;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &action, nullptr);
+#endif
+  }
 
-          retVal = putC(ri.Value, stdout);
+  // Terminal width in columns. Only asks the OS if the terminal was resized since last time.
+  unsigned int TerminalSize::Width()
+  {
+    if (pending_.load(std::memory_order_relaxed))
+      refresh();
+    return width_.load(std::memory_order_relaxed);
+  }
 
-          if (!retVal)
-            return false;
-        }
-      }
+  // Terminal height in rows. Only asks the OS if the terminal was resized since last time.
+  unsigned int TerminalSize::Height()
+  {
+    if (pending_.load(std::memory_order_relaxed))
+      refresh();
+    return height_.load(std::memory_order_relaxed);
+  }
 
-      if (index + 1 >= maxIndex)
-        break;
+  // Brings the size up to date, and returns a number that changes every time the size does.
+  unsigned long TerminalSize::Poll()
+  {
+#ifdef OS_WINDOWS
+    pending_.store(true, std::memory_order_relaxed);
+#endif
+    if (pending_.load(std::memory_order_relaxed))
+      refresh();
+    return generation_.load(std::memory_order_relaxed);
+  }
 
-      data.IncrementX();
+  // Asks the OS for the size. The flag is cleared first so a resize that lands mid-query
+  // is picked up next time rather than lost.
+  void TerminalSize::refresh()
+  {
+    pending_.store(false, std::memory_order_relaxed);
+
+    int columns = -1;
+    int rows = -1;
+#ifdef OS_WINDOWS
+    columns = _rlutil_internal::tcols();
+    rows = _rlutil_internal::trows();
+#else
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 || ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == 0)
+    {
+      columns = size.ws_col;
+      rows = size.ws_row;
     }
+#endif
+    if (columns <= 0 || rows <= 0)
+      return;
 
-    // Return we successfully printed the raster!
-    return true;
+    const unsigned int width = static_cast<unsigned int>(columns);
+    const unsigned int height = static_cast<unsigned int>(rows);
+    if (width == width_.load(std::memory_order_relaxed) && height == height_.load(std::memory_order_relaxed) && generation_.load(std::memory_order_relaxed) != 0)
+      return;
+
+    width_.store(width, std::memory_order_relaxed);
+    height_.store(height, std::memory_order_relaxed);
+    generation_.fetch_add(1, std::memory_order_relaxed);
   }
 
-  // Cross-platform putc
-  int Canvas::putC(int character, FILE * stream)
+  // SIGWINCH handler. Only raises the flag- everything else waits for the next read.
+  void TerminalSize::onResize(int signalNum)
   {
-#if defined(RConsole_NO_THREADING) && defined(OS_WINDOWS)
-    return _putc_nolock(character, stream);
-#else
-    return putc(character, stream);
-#endif
+    UNUSED(signalNum);
+    pending_.store(true, std::memory_order_relaxed);
   }
 
 
-  // print out the formatted raster.
-  // Note that because of console color formatting, we use the _rlutil_internal coloring option when
-  // we are printing to the console, or have no file output specified.
-  void Canvas::DumpRaster(FILE * fp)
+  /////////////////
+ // Worker pool //
+/////////////////
+// Gets the shared pool, starting its threads the first time it is used.
+  WorkerPool &WorkerPool::Instance()
   {
-    // Dump only relevant part of stream.
-    for (unsigned int i = 0; i < height_; ++i)
-    {
-      for (unsigned int j = 0; j < width_; ++j)
-      {
-        const RasterInfo &ri = r_.GetRasterData().Peek(j, i);
-        if (fp == stdout)
-        {
-          _rlutil_internal::setColor(ri.C);
-          std::cout << ri.Value;//fprintf(fp, "%c", ri.Value);
-        }
-        else
-        {
-          std::string line = _rlutil_internal::getANSIColor(ri.C) + ri.Value;
-          fprintf(fp, "%s", line.c_str());
-        }
-      }
+    static WorkerPool pool;
+    return pool;
+  }
+
+  // Starts one thread less than the hardware has, since the caller helps out.
+  WorkerPool::WorkerPool()
+    : task_(nullptr)
+    , taskCount_(0)
+    , nextTask_(0)
+    , remaining_(0)
+    , active_(0)
+    , generation_(0)
+    , stopping_(false)
+  {
+    const unsigned int hardware = std::thread::hardware_concurrency();
+    for (unsigned int i = 1; i < hardware; ++i)
+      threads_.push_back(std::thread(&WorkerPool::workerLoop, this));
+  }
 
-      std::cout << '\n';
-      //fprintf(fp, "\n");
+  // Stops and joins all threads.
+  WorkerPool::~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
     }
+    wake_.notify_all();
 
-    // Set end color to white when we're done.
-    if (fp == stdout)
-      _rlutil_internal::setColor(WHITE);
+    for (std::thread &thread : threads_)
+      thread.join();
   }
 
+  // Number of threads besides the caller that can pick up tasks.
+  unsigned int WorkerPool::ThreadCount() const
+  {
+    return static_cast<unsigned int>(threads_.size());
+  }
 
-  // Crops all of the raster
-  void Canvas::CropRaster(FILE *fp, char toTrim)
+  // Runs task(0) through task(taskCount - 1) across the pool and waits for all of them.
+  void WorkerPool::Run(unsigned int taskCount, const std::function<void(unsigned int)> &task)
   {
-    // Establish borders.
-    unsigned int Xmin = width_;
-    unsigned int Xmax = 0;
-    unsigned int Ymin = height_;
-    unsigned int Ymax = 0;
+    if (taskCount == 0)
+      return;
 
-    for (unsigned int i = 0; i < width_; ++i)
     {
-      for (unsigned int j = 0; j < height_; ++j)
-      {
-        if (r_.GetRasterData().Peek(i, j).Value != toTrim)
-        {
-          if (i < Xmin) Xmin = i;
-          if (j < Ymin) Ymin = j;
-          if (i > Xmax) Xmax = i;
-          if (j > Ymax) Ymax = j;
-        }
-      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      taskCount_ = taskCount;
+      nextTask_ = 0;
+      remaining_ = taskCount;
+      ++generation_;
     }
+    wake_.notify_all();
 
-    // If we're trimming everything, don't even bother.
-    if (Xmin > Xmax) return;
-    if (Ymin > Ymax) return;
+    runTasks(task, taskCount);
+
+    // Workers that are still between tasks have to finish before the task can go away.
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return remaining_ == 0 && active_ == 0; });
+    task_ = nullptr;
+  }
 
-    // Dump only relevant part of stream.
-    for (unsigned int j = Ymin; j <= Ymax; ++j)
+  // Takes tasks until there are none left.
+  void WorkerPool::runTasks(const std::function<void(unsigned int)> &task, unsigned int taskCount)
+  {
+    while (true)
     {
-      for (unsigned int i = Xmin; i <= Xmax; ++i)
-      {
-        const RasterInfo &ri = r_.GetRasterData().Peek(i, j);
-        if (fp == stdout)
-        {
-          _rlutil_internal::setColor(ri.C);
-          fprintf(fp, "%c", ri.Value);
-        }
-        else
-        {
-          std::string line = _rlutil_internal::getANSIColor(ri.C) + ri.Value;
-          fprintf(fp, "%s", line.c_str());
-        }
-      }
+      const unsigned int index = nextTask_.fetch_add(1);
+      if (index >= taskCount)
+        break;
 
-      fprintf(fp, "\n");
-    }
+      task(index);
 
-    // Set end color to white when we're done.
-    if (fp == stdout)
-      _rlutil_internal::setColor(WHITE);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--remaining_ == 0)
+        done_.notify_all();
+    }
   }
 
-
-  // Returns the location in memory of the object when it was created.
-  unsigned long Canvas::GetMemID()
+  // Waits for a new batch of tasks, helps with it, and repeats until stopped.
+  void WorkerPool::workerLoop()
   {
-    return memoryId_;
+    unsigned long seen = 0;
+    while (true)
+    {
+      const std::function<void(unsigned int)> *task = nullptr;
+      unsigned int taskCount = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this, seen]() { return stopping_ || (generation_ != seen && task_ != nullptr); });
+        if (stopping_)
+          return;
+
+        seen = generation_;
+        task = task_;
+        taskCount = taskCount_;
+        ++active_;
+      }
+
+      runTasks(*task, taskCount);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_.notify_all();
+    }
   }
 
   namespace RConsoleConfig
@@ -1405,23 +4315,100 @@ namespace RConsole
     std::unordered_map<long, Canvas *> ActiveCanvases = std::unordered_map<long, Canvas *>();
     bool HasInitializedGlobalSignals = false;
 
+    // Set by the close handler to the signal that asked us to close, and read by the frame loop.
+    std::atomic<int> CloseSignal(0);
+#ifdef OS_POSIX
+    // Self-pipe written to by the close handler, so anything waiting on input wakes up.
+    int WakePipe[2] = { -1, -1 };
+#endif
+
+    // Close handler. Only does what is safe inside a signal handler: records the signal and
+    // pokes the wake pipe. The next Update restores the terminal and exits. If the signal
+    // comes again before that happens, the program is stuck somewhere, so put the cursor and
+    // colors back with a raw write and leave immediately.
     void SignalHandler(int signalNum)
     {
-      for (auto &pair : ActiveCanvases)
-        pair.second->Shutdown();
+      int expected = 0;
+      if (!CloseSignal.compare_exchange_strong(expected, signalNum))
+      {
+#ifdef OS_POSIX
+        static const char restore[] = "\033[0m\033[?25h\n";
+        ssize_t ignored = write(STDOUT_FILENO, restore, sizeof(restore) - 1);
+        UNUSED(ignored);
+#endif
+        _exit(signalNum);
+      }
 
-      std::this_thread::sleep_for(std::chrono::milliseconds(500));
-      int height = _rlutil_internal::trows();
-      _rlutil_internal::locate(0, height);
-      _rlutil_internal::setColor(WHITE);
-      std::cout << '\n';
-      exit(signalNum);
+#ifdef OS_POSIX
+      if (WakePipe[1] != -1)
+      {
+        const char wake = 0;
+        ssize_t ignored = write(WakePipe[1], &wake, 1);
+        UNUSED(ignored);
+      }
+#endif
     }
 
     void SetCloseHandler()
     {
+#ifdef OS_POSIX
+      if (pipe(WakePipe) == 0)
+      {
+        for (int i = 0; i < 2; ++i)
+        {
+          fcntl(WakePipe[i], F_SETFL, fcntl(WakePipe[i], F_GETFL) | O_NONBLOCK);
+          fcntl(WakePipe[i], F_SETFD, FD_CLOEXEC);
+        }
+      }
+
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = SignalHandler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      sigaction(SIGTERM, &action, nullptr);
+      sigaction(SIGINT, &action, nullptr);
+#else
       signal(SIGTERM, SignalHandler);
       signal(SIGINT, SignalHandler);
+#endif
+    }
+
+    // Whether a close signal has come in.
+    bool CloseRequested()
+    {
+      return CloseSignal.load() != 0;
+    }
+
+    // The read end of the wake pipe, which becomes readable when a close signal comes in.
+    // -1 if there isn't one.
+    int WakeFd()
+    {
+#ifdef OS_POSIX
+      return WakePipe[0];
+#else
+      return -1;
+#endif
+    }
+
+    // Called from the frame loop. If a close signal came in, stops every canvas, puts the
+    // cursor below the drawing with colors reset and the cursor showing, then exits. Any frame
+    // that was being written when the signal landed has already finished by the time we're here.
+    void CheckClose()
+    {
+      const int signalNum = CloseSignal.load();
+      if (signalNum == 0)
+        return;
+
+      for (auto &pair : ActiveCanvases)
+        pair.second->Shutdown();
+
+      _rlutil_internal::locate(1, static_cast<int>(TerminalSize::Height()));
+      fputs("\033[0m", stdout);
+      _rlutil_internal::showcursor();
+      fputs("\n", stdout);
+      fflush(stdout);
+      exit(signalNum);
     }
 
     void RemoveObject(Canvas *c) { ActiveCanvases.erase(c->GetMemID()); }
@@ -1431,6 +4418,7 @@ namespace RConsole
       if (!HasInitializedGlobalSignals)
       {
         SetCloseHandler();
+        TerminalSize::Install();
         HasInitializedGlobalSignals = true;
       }
     }
@@ -0,0 +1,621 @@
+#pragma once
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+// Includes
+#include <chrono>           // Frame deadlines
+#include <cstdlib>          // Restoring the terminal at exit
+#include "Canvas.hpp"
+
+#ifdef OS_POSIX
+#include <termios.h>        // Raw mode
+#include <poll.h>           // Waiting on stdin
+#endif
+
+// Most events the input queue holds before new ones are dropped.
+#ifndef RConsole_INPUT_QUEUE_SIZE
+#define RConsole_INPUT_QUEUE_SIZE 256
+#endif
+
+// Bytes read from the terminal in one go, including any partial escape sequence held over.
+#ifndef RConsole_INPUT_BUFFER_SIZE
+#define RConsole_INPUT_BUFFER_SIZE 512
+#endif
+
+// How long to wait for the rest of an escape sequence before treating ESC as its own key.
+#ifndef RConsole_INPUT_ESCAPE_MS
+#define RConsole_INPUT_ESCAPE_MS 25
+#endif
+
+
+// Keyboard input. The terminal is put into raw mode, waited on with poll alongside the frame
+// timer, and escape sequences are decoded into a fixed ring of events- nothing is allocated
+// once the Input object exists.
+namespace RConsole
+{
+  // What kind of event came in.
+  enum InputEventType
+  {
+    INPUT_EVENT_KEY,    // A key press. Key is a codepoint or one of InputKey.
+    INPUT_EVENT_PASTE   // One codepoint of bracketed paste. Newlines come through as '\n'.
+  };
+
+  // Keys that aren't plain text. Values past the end of Unicode can't be confused with text.
+  enum InputKey
+  {
+    INPUT_KEY_TAB = 0x09,
+    INPUT_KEY_ENTER = 0x0D,
+    INPUT_KEY_ESCAPE = 0x1B,
+    INPUT_KEY_BACKSPACE = 0x7F,
+    INPUT_KEY_UP = 0x110100,
+    INPUT_KEY_DOWN,
+    INPUT_KEY_LEFT,
+    INPUT_KEY_RIGHT,
+    INPUT_KEY_HOME,
+    INPUT_KEY_END,
+    INPUT_KEY_INSERT,
+    INPUT_KEY_DELETE,
+    INPUT_KEY_PAGE_UP,
+    INPUT_KEY_PAGE_DOWN,
+    INPUT_KEY_F1,
+    INPUT_KEY_F2,
+    INPUT_KEY_F3,
+    INPUT_KEY_F4,
+    INPUT_KEY_F5,
+    INPUT_KEY_F6,
+    INPUT_KEY_F7,
+    INPUT_KEY_F8,
+    INPUT_KEY_F9,
+    INPUT_KEY_F10,
+    INPUT_KEY_F11,
+    INPUT_KEY_F12
+  };
+
+  // Modifier bits. Ctrl with a letter comes through as the lowercase letter with INPUT_MOD_CTRL.
+  enum InputModifier
+  {
+    INPUT_MOD_NONE = 0,
+    INPUT_MOD_SHIFT = 1,
+    INPUT_MOD_ALT = 2,
+    INPUT_MOD_CTRL = 4
+  };
+
+  // A single decoded event.
+  struct InputEvent
+  {
+    InputEventType Type;
+    uint32_t Key;
+    unsigned int Modifiers;
+  };
+
+  // Reads the keyboard without spinning. Call Wait (or WaitUntil with the time the next frame is
+  // due) in the frame loop: it sleeps until input arrives or time is up, whichever is first, so
+  // a key press is handled as soon as it comes in rather than on the next frame. Ctrl+C still
+  // raises SIGINT, and the close handler cuts the wait short so the next Update can exit. The
+  // terminal is restored on exit even if the Input is never destroyed.
+  class Input
+  {
+  public:
+    // Constructor
+    Input();
+    ~Input();
+
+    // Terminal setup
+    bool Open();
+    void Close();
+    bool IsOpen() const;
+
+    // Reading
+    bool Wait(int timeoutMs);
+    bool WaitUntil(std::chrono::steady_clock::time_point deadline);
+    bool Poll(InputEvent &event);
+    size_t Pending() const;
+    unsigned long Dropped() const;
+
+  private:
+    // Hidden Constructors
+    Input(const Input &rhs);
+    Input &operator=(const Input &rhs);
+
+    // Private methods.
+    bool readAvailable(int timeoutMs);
+    void decode(bool flush);
+    size_t decodeEscape(const char *bytes, size_t len, bool flush);
+    size_t decodeText(const char *bytes, size_t len, bool flush);
+    void pushKey(uint32_t key, unsigned int modifiers);
+    void push(InputEventType type, uint32_t key, unsigned int modifiers);
+    static void restoreAtExit();
+
+    // Event ring
+    InputEvent events_[RConsole_INPUT_QUEUE_SIZE];
+    size_t head_;
+    size_t count_;
+    unsigned long dropped_;
+
+    // Bytes read but not yet decoded
+    char bytes_[RConsole_INPUT_BUFFER_SIZE];
+    size_t byteCount_;
+
+    // State
+    bool open_;
+    bool pasting_;
+#ifdef OS_POSIX
+    struct termios saved_;
+#elif defined(OS_WINDOWS)
+    DWORD savedMode_;
+    wchar_t highSurrogate_;
+#endif
+
+    // The open input, restored when the program exits.
+    static Input *active_;
+    static bool exitHookInstalled_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  ///////////
+ // Input //
+///////////
+// Static initialization.
+  Input *Input::active_ = nullptr;
+  bool Input::exitHookInstalled_ = false;
+
+  // Constructor, the terminal is left alone until Open.
+  Input::Input()
+    : head_(0)
+    , count_(0)
+    , dropped_(0)
+    , byteCount_(0)
+    , open_(false)
+    , pasting_(false)
+  {
+#ifdef OS_WINDOWS
+    savedMode_ = 0;
+    highSurrogate_ = 0;
+#endif
+  }
+
+  // Puts the terminal back the way it was.
+  Input::~Input()
+  {
+    Close();
+  }
+
+  // Puts the terminal into raw mode and turns on bracketed paste. Returns false if input
+  // isn't a terminal.
+  bool Input::Open()
+  {
+    if (open_)
+      return true;
+
+#ifdef OS_POSIX
+    if (tcgetattr(STDIN_FILENO, &saved_) != 0)
+      return false;
+
+    struct termios raw = saved_;
+    raw.c_iflag &= ~(ICRNL | INLCR | IGNCR | IXON);
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0)
+      return false;
+#elif defined(OS_WINDOWS)
+    HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
+    if (!GetConsoleMode(console, &savedMode_))
+      return false;
+
+    // Keep processed input so Ctrl+C is still a signal. 0x0200 is ENABLE_VIRTUAL_TERMINAL_INPUT.
+    const DWORD raw = (savedMode_ & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT)) | 0x0200;
+    if (!SetConsoleMode(console, raw))
+      return false;
+#endif
+
+    fputs("\033[?2004h", stdout);
+    fflush(stdout);
+    open_ = true;
+
+    active_ = this;
+    if (!exitHookInstalled_)
+    {
+      atexit(restoreAtExit);
+      exitHookInstalled_ = true;
+    }
+    return true;
+  }
+
+  // Restores the terminal. Safe to call more than once.
+  void Input::Close()
+  {
+    if (!open_)
+      return;
+
+    fputs("\033[?2004l", stdout);
+    fflush(stdout);
+#ifdef OS_POSIX
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved_);
+#elif defined(OS_WINDOWS)
+    SetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), savedMode_);
+#endif
+    open_ = false;
+    if (active_ == this)
+      active_ = nullptr;
+  }
+
+  // Whether the terminal is in raw mode.
+  bool Input::IsOpen() const
+  {
+    return open_;
+  }
+
+  // Waits up to timeoutMs for input (a negative timeout waits for as long as it takes), then
+  // decodes everything that came in. Returns whether there are events to Poll. An escape
+  // sequence split across reads is given a moment to finish before ESC counts as a key. Input
+  // that didn't fit in the queue, such as the tail of a long paste, is decoded on later waits.
+  // Once a close has been requested this returns right away, so the caller gets back to Update.
+  bool Input::Wait(int timeoutMs)
+  {
+    if (!open_ || RConsoleConfig::CloseRequested())
+      return count_ > 0;
+    if (count_ > 0 || byteCount_ > 0)
+      timeoutMs = 0;
+
+    readAvailable(timeoutMs);
+    decode(false);
+    if (RConsoleConfig::CloseRequested())
+      return count_ > 0;
+    if (byteCount_ > 0 && count_ < RConsole_INPUT_QUEUE_SIZE)
+    {
+      if (readAvailable(RConsole_INPUT_ESCAPE_MS))
+        decode(false);
+      decode(true);
+    }
+
+    return count_ > 0;
+  }
+
+  // Waits for input until the given time, usually when the next frame is due.
+  bool Input::WaitUntil(std::chrono::steady_clock::time_point deadline)
+  {
+    const long long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return Wait(remaining > 0 ? static_cast<int>(remaining) : 0);
+  }
+
+  // Takes the oldest event off the queue. Returns false if there wasn't one.
+  bool Input::Poll(InputEvent &event)
+  {
+    if (count_ == 0)
+      return false;
+
+    event = events_[head_];
+    head_ = (head_ + 1) % RConsole_INPUT_QUEUE_SIZE;
+    --count_;
+    return true;
+  }
+
+  // How many events are waiting.
+  size_t Input::Pending() const
+  {
+    return count_;
+  }
+
+  // How many events were dropped because the queue was full.
+  unsigned long Input::Dropped() const
+  {
+    return dropped_;
+  }
+
+  // Reads whatever input is available after waiting up to timeoutMs for some. Returns whether
+  // anything was read. A signal (such as a resize) or a close request cuts the wait short.
+  bool Input::readAvailable(int timeoutMs)
+  {
+    if (byteCount_ == RConsole_INPUT_BUFFER_SIZE)
+      return false;
+
+#ifdef OS_POSIX
+    // Negative descriptors are ignored by poll, so no wake pipe is fine.
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[1].fd = RConsoleConfig::WakeFd();
+    for (int i = 0; i < 2; ++i)
+    {
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if (poll(fds, 2, timeoutMs) <= 0)
+      return false;
+
+    // Drain the wake pipe. The close request itself stays set for Update to act on.
+    if (fds[1].revents & POLLIN)
+    {
+      char drain[16];
+      while (read(fds[1].fd, drain, sizeof(drain)) > 0);
+    }
+    if (!(fds[0].revents & POLLIN))
+      return false;
+
+    const ssize_t got = read(STDIN_FILENO, bytes_ + byteCount_, RConsole_INPUT_BUFFER_SIZE - byteCount_);
+    if (got <= 0)
+      return false;
+
+    byteCount_ += static_cast<size_t>(got);
+    return true;
+#elif defined(OS_WINDOWS)
+    HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
+    if (WaitForSingleObject(console, timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs)) != WAIT_OBJECT_0)
+      return false;
+
+    // With virtual terminal input on, escape sequences arrive as a run of key events.
+    INPUT_RECORD records[64];
+    DWORD recordCount = 0;
+    if (!ReadConsoleInputW(console, records, 64, &recordCount))
+      return false;
+
+    const size_t before = byteCount_;
+    std::string utf8;
+    for (DWORD i = 0; i < recordCount; ++i)
+    {
+      if (records[i].EventType != KEY_EVENT || !records[i].Event.KeyEvent.bKeyDown)
+        continue;
+
+      const wchar_t unit = records[i].Event.KeyEvent.uChar.UnicodeChar;
+      if (unit == 0)
+        continue;
+      if (unit >= 0xD800 && unit <= 0xDBFF)
+      {
+        highSurrogate_ = unit;
+        continue;
+      }
+
+      Glyph codepoint = unit;
+      if (unit >= 0xDC00 && unit <= 0xDFFF && highSurrogate_ != 0)
+        codepoint = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (unit - 0xDC00);
+      highSurrogate_ = 0;
+
+      utf8.clear();
+      AppendGlyph(utf8, codepoint);
+      if (byteCount_ + utf8.size() > RConsole_INPUT_BUFFER_SIZE)
+        break;
+      memcpy(bytes_ + byteCount_, utf8.data(), utf8.size());
+      byteCount_ += utf8.size();
+    }
+
+    return byteCount_ != before;
+#else
+    UNUSED(timeoutMs);
+    return false;
+#endif
+  }
+
+  // Turns buffered bytes into events. Sequences cut off at the end of the buffer are kept for
+  // the next read, unless flushing, in which case they're decoded as best they can be. Stops
+  // once the queue is full, leaving the rest buffered until events are polled off.
+  void Input::decode(bool flush)
+  {
+    size_t read = 0;
+    while (read < byteCount_ && count_ < RConsole_INPUT_QUEUE_SIZE)
+    {
+      const size_t used = (bytes_[read] == 0x1B)
+        ? decodeEscape(bytes_ + read, byteCount_ - read, flush)
+        : decodeText(bytes_ + read, byteCount_ - read, flush);
+      if (used == 0)
+        break;
+      read += used;
+    }
+
+    memmove(bytes_, bytes_ + read, byteCount_ - read);
+    byteCount_ -= read;
+  }
+
+  // Decodes an escape sequence: CSI (ESC [) and SS3 (ESC O) keys with xterm modifiers, bracketed
+  // paste markers, and ESC in front of a key for Alt. Returns bytes used, or 0 if incomplete.
+  size_t Input::decodeEscape(const char *bytes, size_t len, bool flush)
+  {
+    if (len == 1)
+    {
+      if (!flush)
+        return 0;
+      pushKey(INPUT_KEY_ESCAPE, INPUT_MOD_NONE);
+      return 1;
+    }
+
+    // SS3, sent for F1-F4 and by some terminals for arrows, home and end.
+    if (bytes[1] == 'O')
+    {
+      if (len < 3)
+      {
+        if (!flush)
+          return 0;
+        pushKey('O', INPUT_MOD_ALT);
+        return 2;
+      }
+
+      switch (bytes[2])
+      {
+        case 'A': pushKey(INPUT_KEY_UP, INPUT_MOD_NONE); break;
+        case 'B': pushKey(INPUT_KEY_DOWN, INPUT_MOD_NONE); break;
+        case 'C': pushKey(INPUT_KEY_RIGHT, INPUT_MOD_NONE); break;
+        case 'D': pushKey(INPUT_KEY_LEFT, INPUT_MOD_NONE); break;
+        case 'H': pushKey(INPUT_KEY_HOME, INPUT_MOD_NONE); break;
+        case 'F': pushKey(INPUT_KEY_END, INPUT_MOD_NONE); break;
+        case 'P': pushKey(INPUT_KEY_F1, INPUT_MOD_NONE); break;
+        case 'Q': pushKey(INPUT_KEY_F2, INPUT_MOD_NONE); break;
+        case 'R': pushKey(INPUT_KEY_F3, INPUT_MOD_NONE); break;
+        case 'S': pushKey(INPUT_KEY_F4, INPUT_MOD_NONE); break;
+        default: break;
+      }
+      return 3;
+    }
+
+    // Anything other than CSI is Alt with the next key, or a lone ESC.
+    if (bytes[1] != '[')
+    {
+      if (bytes[1] == 0x1B || static_cast<unsigned char>(bytes[1]) >= 0x80)
+      {
+        pushKey(INPUT_KEY_ESCAPE, INPUT_MOD_NONE);
+        return 1;
+      }
+
+      const size_t before = count_;
+      decodeText(bytes + 1, len - 1, true);
+      if (count_ > before)
+        events_[(head_ + count_ - 1) % RConsole_INPUT_QUEUE_SIZE].Modifiers |= INPUT_MOD_ALT;
+      return 2;
+    }
+
+    // CSI: numeric parameters separated by ';', then a final byte.
+    unsigned int params[4] = { 0, 0, 0, 0 };
+    unsigned int paramCount = 0;
+    size_t i = 2;
+    for (; i < len; ++i)
+    {
+      const char c = bytes[i];
+      if (c >= '0' && c <= '9')
+      {
+        if (paramCount == 0)
+          paramCount = 1;
+        if (paramCount <= 4)
+          params[paramCount - 1] = params[paramCount - 1] * 10 + (c - '0');
+      }
+      else if (c == ';')
+        ++paramCount;
+      else if (c >= 0x40 && c <= 0x7E)
+        break;
+    }
+    if (i == len)
+    {
+      if (!flush)
+        return 0;
+      pushKey(INPUT_KEY_ESCAPE, INPUT_MOD_NONE);
+      return 1;
+    }
+
+    // xterm sends modifiers as 1 + bits in the second parameter.
+    const unsigned int modifiers = (paramCount >= 2 && params[1] > 1) ? (params[1] - 1) & 7 : 0u;
+    switch (bytes[i])
+    {
+      case 'A': pushKey(INPUT_KEY_UP, modifiers); break;
+      case 'B': pushKey(INPUT_KEY_DOWN, modifiers); break;
+      case 'C': pushKey(INPUT_KEY_RIGHT, modifiers); break;
+      case 'D': pushKey(INPUT_KEY_LEFT, modifiers); break;
+      case 'H': pushKey(INPUT_KEY_HOME, modifiers); break;
+      case 'F': pushKey(INPUT_KEY_END, modifiers); break;
+      case 'P': pushKey(INPUT_KEY_F1, modifiers); break;
+      case 'Q': pushKey(INPUT_KEY_F2, modifiers); break;
+      case 'R': pushKey(INPUT_KEY_F3, modifiers); break;
+      case 'S': pushKey(INPUT_KEY_F4, modifiers); break;
+      case 'Z': pushKey(INPUT_KEY_TAB, INPUT_MOD_SHIFT); break;
+      case '~':
+        switch (params[0])
+        {
+          case 1: case 7: pushKey(INPUT_KEY_HOME, modifiers); break;
+          case 2: pushKey(INPUT_KEY_INSERT, modifiers); break;
+          case 3: pushKey(INPUT_KEY_DELETE, modifiers); break;
+          case 4: case 8: pushKey(INPUT_KEY_END, modifiers); break;
+          case 5: pushKey(INPUT_KEY_PAGE_UP, modifiers); break;
+          case 6: pushKey(INPUT_KEY_PAGE_DOWN, modifiers); break;
+          case 11: case 12: case 13: case 14: case 15:
+            pushKey(INPUT_KEY_F1 + (params[0] - 11), modifiers); break;
+          case 17: case 18: case 19: case 20: case 21:
+            pushKey(INPUT_KEY_F6 + (params[0] - 17), modifiers); break;
+          case 23: case 24:
+            pushKey(INPUT_KEY_F11 + (params[0] - 23), modifiers); break;
+          case 200: pasting_ = true; break;
+          case 201: pasting_ = false; break;
+          default: break;
+        }
+        break;
+      default: break;
+    }
+
+    return i + 1;
+  }
+
+  // Decodes one UTF-8 codepoint or control byte. Returns bytes used, or 0 if incomplete.
+  size_t Input::decodeText(const char *bytes, size_t len, bool flush)
+  {
+    const unsigned char lead = static_cast<unsigned char>(bytes[0]);
+    if (lead < 0x80)
+    {
+      if (pasting_)
+        push(INPUT_EVENT_PASTE, (lead == '\r') ? '\n' : lead, INPUT_MOD_NONE);
+      else if (lead == '\r' || lead == '\n')
+        pushKey(INPUT_KEY_ENTER, INPUT_MOD_NONE);
+      else if (lead == '\t')
+        pushKey(INPUT_KEY_TAB, INPUT_MOD_NONE);
+      else if (lead == 0x7F || lead == 0x08)
+        pushKey(INPUT_KEY_BACKSPACE, INPUT_MOD_NONE);
+      else if (lead == 0)
+        pushKey(' ', INPUT_MOD_CTRL);
+      else if (lead <= 26)
+        pushKey('a' + lead - 1, INPUT_MOD_CTRL);
+      else if (lead < 0x20)
+        pushKey(lead + 0x40, INPUT_MOD_CTRL);
+      else
+        pushKey(lead, INPUT_MOD_NONE);
+      return 1;
+    }
+
+    // Multi-byte codepoint. Stray continuation bytes and invalid leads are skipped, as is the
+    // lead of a malformed sequence, so the bytes after it are still read as keys of their own.
+    const size_t length = (lead >= 0xF8) ? 1 : (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC0) ? 2 : 1;
+    if (length == 1)
+      return 1;
+
+    uint32_t codepoint = lead & (0x7F >> length);
+    for (size_t i = 1; i < length && i < len; ++i)
+    {
+      const unsigned char next = static_cast<unsigned char>(bytes[i]);
+      if ((next & 0xC0) != 0x80)
+        return 1;
+      codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    if (len < length)
+      return flush ? len : 0;
+
+    // Overlong forms, surrogates and anything past the end of Unicode, which could pass for keys.
+    static const uint32_t smallest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (codepoint < smallest[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+      return 1;
+
+    push(pasting_ ? INPUT_EVENT_PASTE : INPUT_EVENT_KEY, codepoint, INPUT_MOD_NONE);
+    return length;
+  }
+
+  // Puts the terminal back if the program exits with input still open.
+  void Input::restoreAtExit()
+  {
+    if (active_ != nullptr)
+      active_->Close();
+  }
+
+  // Queues a key press.
+  void Input::pushKey(uint32_t key, unsigned int modifiers)
+  {
+    push(INPUT_EVENT_KEY, key, modifiers);
+  }
+
+  // Queues an event, or counts it as dropped if the queue is full.
+  void Input::push(InputEventType type, uint32_t key, unsigned int modifiers)
+  {
+    if (count_ == RConsole_INPUT_QUEUE_SIZE)
+    {
+      ++dropped_;
+      return;
+    }
+
+    InputEvent &event = events_[(head_ + count_) % RConsole_INPUT_QUEUE_SIZE];
+    event.Type = type;
+    event.Key = key;
+    event.Modifiers = modifiers;
+    ++count_;
+  }
+}
+
+#endif
@@ -0,0 +1,628 @@
+#pragma once
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+
+// Includes
+#include <vector>           // Keyframe index, replay data
+#include <algorithm>        // Seeking through the index
+#include <chrono>           // Timestamps and playback pacing
+#include <functional>       // Replay sinks
+#include "Canvas.hpp"
+
+// Recorders hold this much encoded data before writing it out.
+#ifndef RConsole_RECORD_FLUSH_BYTES
+#define RConsole_RECORD_FLUSH_BYTES 65536
+#endif
+
+// Default time between keyframes, in milliseconds.
+#ifndef RConsole_RECORD_KEYFRAME_MS
+#define RConsole_RECORD_KEYFRAME_MS 5000
+#endif
+
+// Most cells a keyframe can hold. Anything bigger is taken to be a malformed record.
+#ifndef RConsole_RECORD_MAX_CELLS
+#define RConsole_RECORD_MAX_CELLS (1 << 24)
+#endif
+
+
+// Recording and replay of what canvases put on screen. Frames are stored as the spans of cells
+// that changed, run-length encoded, with a full keyframe every so often to seek to.
+//
+// A stream is an 8 byte header ("RCFRAME2") followed by records. Each record is a kind byte
+// ('K' for keyframes, 'D' for deltas) and a 32 bit little endian body length, then a body of
+// varints: the time in microseconds since recording started, the width and height for
+// keyframes, the span count, and for every span its x, y and length followed by runs of
+// identical cells (count, glyph, then a color byte) covering it. Glyphs are written shifted up
+// a bit; interned clusters instead set the low bit over their byte length and are followed by
+// their UTF-8, since pool indices only mean something to the process that made them. Version 1
+// streams wrote the raw pool index instead, so they don't pass CheckHeader.
+namespace RConsole
+{
+  // Kinds of frame records.
+  enum FrameKind
+  {
+    FRAME_KEY = 'K',    // Every cell of the frame.
+    FRAME_DELTA = 'D'   // Only the cells that changed since the frame before.
+  };
+
+  // Reads and writes single frame records.
+  class FrameCodec
+  {
+  public:
+    // Static member functions
+    static void WriteHeader(std::string &out);
+    static bool CheckHeader(const char *data, size_t len);
+    static void EncodeKeyframe(std::string &out, uint64_t timeUs, Field2DView<const RasterInfo> frame);
+    static void EncodeDelta(std::string &out, uint64_t timeUs, const FrameSpan *spans, size_t count);
+    static size_t Peek(const char *data, size_t len, uint64_t &timeUs, FrameKind &kind);
+    static size_t Decode(const char *data, size_t len, Field2D<RasterInfo> &frame, uint64_t &timeUs, FrameKind &kind);
+
+    // Sizes
+    static const size_t HeaderSize = 8;
+    static const size_t RecordHeaderSize = 5;
+    static const size_t Malformed = ~static_cast<size_t>(0);
+
+  private:
+    // Private methods.
+    static size_t beginRecord(std::string &out, FrameKind kind, uint64_t timeUs);
+    static void endRecord(std::string &out, size_t start);
+    static void appendVarint(std::string &out, uint64_t value);
+    static bool readVarint(const char *&read, const char *end, uint64_t &value);
+    static void appendCells(std::string &out, const RasterInfo *cells, unsigned int count);
+  };
+
+  // Writes every frame of the canvases it observes to a file. Frames with nothing changed cost
+  // nothing, and the rest cost about what changed in them, so it can be left on all the time.
+  // Output is buffered and written when the buffer fills or a keyframe is written, so a crash
+  // loses at most a keyframe interval.
+  class FrameRecorder : public FrameObserver
+  {
+  public:
+    // Constructor
+    FrameRecorder();
+    ~FrameRecorder();
+
+    // Recording
+    bool Open(const char *path);
+    void Close();
+    bool IsOpen() const;
+    void SetKeyframeInterval(unsigned int milliseconds);
+    void OnFrame(const Canvas &canvas, const FrameSpan *spans, size_t count);
+
+  private:
+    // Hidden Constructors
+    FrameRecorder(const FrameRecorder &rhs);
+    FrameRecorder &operator=(const FrameRecorder &rhs);
+
+    // Private methods.
+    void flush();
+
+    // Variables
+    FILE *file_;
+    std::string buffer_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t keyframeIntervalUs_;
+    uint64_t lastKeyframeUs_;
+    unsigned int width_;
+    unsigned int height_;
+    bool needKeyframe_;
+  };
+
+  // Plays back a recording. Any point in it can be sought to by decoding forward from the
+  // keyframe before it, and frames can be played at any speed into a canvas or any other sink.
+  // Recordings cut short by a crash play up to the last whole frame.
+  class FrameReplayer
+  {
+  public:
+    // Constructor
+    FrameReplayer();
+
+    // Loading
+    bool Open(const char *path);
+    bool Load(const char *data, size_t len);
+
+    // Position
+    uint64_t Duration() const;
+    uint64_t Time() const;
+    bool Seek(uint64_t timeUs);
+    bool Next();
+    const Field2D<RasterInfo> &Frame() const;
+
+    // Playback from the current position. A speed of 0 or less plays as fast as it can.
+    void Play(const std::function<bool(const Field2D<RasterInfo> &, uint64_t)> &sink, double speed = 1.0);
+    void Play(Canvas &canvas, double speed = 1.0);
+
+  private:
+    // Where a keyframe starts, and when it was.
+    struct Keyframe
+    {
+      size_t Offset;
+      uint64_t TimeUs;
+    };
+
+    // Variables
+    std::vector<char> data_;
+    std::vector<Keyframe> keyframes_;
+    size_t end_;
+    size_t offset_;
+    uint64_t timeUs_;
+    uint64_t durationUs_;
+    Field2D<RasterInfo> frame_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  /////////////////
+ // Frame codec //
+/////////////////
+// Starts a stream.
+  void FrameCodec::WriteHeader(std::string &out)
+  {
+    out.append("RCFRAME2", HeaderSize);
+  }
+
+  // Whether data starts with a stream header.
+  bool FrameCodec::CheckHeader(const char *data, size_t len)
+  {
+    return len >= HeaderSize && memcmp(data, "RCFRAME2", HeaderSize) == 0;
+  }
+
+  // Appends a record holding every cell of a frame. Each row is one span, so blank rows come
+  // down to a single run.
+  void FrameCodec::EncodeKeyframe(std::string &out, uint64_t timeUs, Field2DView<const RasterInfo> frame)
+  {
+    const size_t start = beginRecord(out, FRAME_KEY, timeUs);
+    appendVarint(out, frame.Width());
+    appendVarint(out, frame.Height());
+    appendVarint(out, frame.Height());
+    for (unsigned int y = 0; y < frame.Height(); ++y)
+    {
+      appendVarint(out, 0);
+      appendVarint(out, y);
+      appendVarint(out, frame.Width());
+      appendCells(out, frame.RowData(y), frame.Width());
+    }
+    endRecord(out, start);
+  }
+
+  // Appends a record holding the spans that changed in a frame.
+  void FrameCodec::EncodeDelta(std::string &out, uint64_t timeUs, const FrameSpan *spans, size_t count)
+  {
+    const size_t start = beginRecord(out, FRAME_DELTA, timeUs);
+    appendVarint(out, count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      appendVarint(out, spans[i].X);
+      appendVarint(out, spans[i].Y);
+      appendVarint(out, spans[i].Length);
+      appendCells(out, spans[i].Cells, spans[i].Length);
+    }
+    endRecord(out, start);
+  }
+
+  // Reads the kind and time of the record at data without applying it. Returns the size of the
+  // whole record, 0 if it is cut off, or Malformed if it isn't a record.
+  size_t FrameCodec::Peek(const char *data, size_t len, uint64_t &timeUs, FrameKind &kind)
+  {
+    if (len < RecordHeaderSize)
+      return 0;
+    if (data[0] != FRAME_KEY && data[0] != FRAME_DELTA)
+      return Malformed;
+
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+    const size_t bodyLength = bytes[1] | (bytes[2] << 8) | (bytes[3] << 16) | (static_cast<size_t>(bytes[4]) << 24);
+    if (len - RecordHeaderSize < bodyLength)
+      return 0;
+
+    const char *read = data + RecordHeaderSize;
+    if (!readVarint(read, read + bodyLength, timeUs))
+      return Malformed;
+
+    kind = static_cast<FrameKind>(data[0]);
+    return RecordHeaderSize + bodyLength;
+  }
+
+  // Applies the record at data to a frame. Keyframes resize the frame to match, and spans are
+  // clipped to it. Returns the size of the whole record, 0 if it is cut off, or Malformed if it
+  // can't be read. Malformed records may have been partly applied.
+  size_t FrameCodec::Decode(const char *data, size_t len, Field2D<RasterInfo> &frame, uint64_t &timeUs, FrameKind &kind)
+  {
+    const size_t size = Peek(data, len, timeUs, kind);
+    if (size == 0 || size == Malformed)
+      return size;
+
+    const char *read = data + RecordHeaderSize;
+    const char *end = data + size;
+    uint64_t value = 0;
+    readVarint(read, end, value);
+
+    uint64_t width = 0;
+    uint64_t height = 0;
+    if (kind == FRAME_KEY && (!readVarint(read, end, width) || !readVarint(read, end, height)))
+      return Malformed;
+
+    uint64_t spanCount = 0;
+    if (!readVarint(read, end, spanCount))
+      return Malformed;
+
+    // Keyframes are one span per row, and their size is checked before anything is allocated.
+    if (kind == FRAME_KEY)
+    {
+      const uint64_t maxCells = RConsole_RECORD_MAX_CELLS;
+      if (spanCount != height || width > maxCells || height > maxCells || width * height > maxCells)
+        return Malformed;
+      if (frame.Width() != width || frame.Height() != height)
+        frame.Resize(static_cast<unsigned int>(width), static_cast<unsigned int>(height));
+    }
+
+    for (uint64_t i = 0; i < spanCount; ++i)
+    {
+      uint64_t x = 0;
+      uint64_t y = 0;
+      uint64_t length = 0;
+      if (!readVarint(read, end, x) || !readVarint(read, end, y) || !readVarint(read, end, length))
+        return Malformed;
+
+      // Runs of identical cells until the span is covered.
+      for (uint64_t done = 0; done < length; )
+      {
+        uint64_t run = 0;
+        uint64_t glyph = 0;
+        if (!readVarint(read, end, run) || !readVarint(read, end, glyph) || run == 0)
+          return Malformed;
+        if (glyph & 1)
+        {
+          const uint64_t bytes = glyph >> 1;
+          if (bytes == 0 || bytes > static_cast<uint64_t>(end - read))
+            return Malformed;
+          glyph = GraphemePool::Intern(read, static_cast<size_t>(bytes));
+          read += bytes;
+        }
+        else
+          glyph >>= 1;
+        if (read == end)
+          return Malformed;
+        const RasterInfo cell(static_cast<Glyph>(glyph), static_cast<Color>(static_cast<unsigned char>(*read++)));
+
+        if (y < frame.Height() && x + done < frame.Width())
+        {
+          const uint64_t visible = std::min(run, frame.Width() - (x + done));
+          RasterInfo *row = frame.Row(static_cast<unsigned int>(y)) + x + done;
+          std::fill(row, row + visible, cell);
+        }
+        done += run;
+      }
+    }
+
+    return size;
+  }
+
+  // Writes the kind byte, leaves room for the body length, and starts the body with the time.
+  // Returns where the record starts.
+  size_t FrameCodec::beginRecord(std::string &out, FrameKind kind, uint64_t timeUs)
+  {
+    const size_t start = out.size();
+    out.push_back(static_cast<char>(kind));
+    out.append(4, '\0');
+    appendVarint(out, timeUs);
+    return start;
+  }
+
+  // Fills in the body length of the record that starts at start.
+  void FrameCodec::endRecord(std::string &out, size_t start)
+  {
+    const size_t bodyLength = out.size() - start - RecordHeaderSize;
+    for (int i = 0; i < 4; ++i)
+      out[start + 1 + i] = static_cast<char>((bodyLength >> (8 * i)) & 0xFF);
+  }
+
+  // Seven bits at a time, low bits first, with the top bit set on every byte but the last.
+  void FrameCodec::appendVarint(std::string &out, uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  // Reads a varint, returning false if it runs off the end.
+  bool FrameCodec::readVarint(const char *&read, const char *end, uint64_t &value)
+  {
+    value = 0;
+    for (unsigned int shift = 0; read != end && shift < 64; shift += 7)
+    {
+      const unsigned char byte = static_cast<unsigned char>(*read++);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  // Appends cells as runs of identical ones.
+  void FrameCodec::appendCells(std::string &out, const RasterInfo *cells, unsigned int count)
+  {
+    unsigned int i = 0;
+    while (i < count)
+    {
+      unsigned int run = 1;
+      while (i + run < count && cells[i + run] == cells[i])
+        ++run;
+
+      appendVarint(out, run);
+      if (cells[i].Value & GLYPH_INTERNED)
+      {
+        size_t bytes = 0;
+        const char *cluster = GraphemePool::Bytes(cells[i].Value, bytes);
+        appendVarint(out, (static_cast<uint64_t>(bytes) << 1) | 1);
+        out.append(cluster, bytes);
+      }
+      else
+        appendVarint(out, static_cast<uint64_t>(cells[i].Value) << 1);
+      out.push_back(static_cast<char>(cells[i].C));
+      i += run;
+    }
+  }
+
+  ////////////////////
+ // Frame recorder //
+////////////////////
+// Constructor, nothing is recorded until Open.
+  FrameRecorder::FrameRecorder()
+    : file_(nullptr)
+    , keyframeIntervalUs_(static_cast<uint64_t>(RConsole_RECORD_KEYFRAME_MS) * 1000)
+    , lastKeyframeUs_(0)
+    , width_(0)
+    , height_(0)
+    , needKeyframe_(true)
+  {  }
+
+  // Writes out anything still buffered.
+  FrameRecorder::~FrameRecorder()
+  {
+    Close();
+  }
+
+  // Starts a new recording at path, replacing anything already there. Time starts now.
+  bool FrameRecorder::Open(const char *path)
+  {
+    Close();
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr)
+      return false;
+
+    buffer_.clear();
+    FrameCodec::WriteHeader(buffer_);
+    start_ = std::chrono::steady_clock::now();
+    needKeyframe_ = true;
+    return true;
+  }
+
+  // Finishes the recording.
+  void FrameRecorder::Close()
+  {
+    if (file_ == nullptr)
+      return;
+
+    flush();
+    fclose(file_);
+    file_ = nullptr;
+  }
+
+  // Whether frames are being recorded.
+  bool FrameRecorder::IsOpen() const
+  {
+    return file_ != nullptr;
+  }
+
+  // Sets the most time that can pass between keyframes. Seeking decodes forward from the
+  // keyframe before, so shorter intervals seek faster and record bigger.
+  void FrameRecorder::SetKeyframeInterval(unsigned int milliseconds)
+  {
+    keyframeIntervalUs_ = static_cast<uint64_t>(milliseconds) * 1000;
+  }
+
+  // Records a frame: a keyframe if it is the first, the canvas changed size, or the interval
+  // is up, otherwise just what changed.
+  void FrameRecorder::OnFrame(const Canvas &canvas, const FrameSpan *spans, size_t count)
+  {
+    if (file_ == nullptr)
+      return;
+
+    const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    const Field2DView<const RasterInfo> frame = canvas.GetRasterView();
+    if (needKeyframe_ || frame.Width() != width_ || frame.Height() != height_ || now - lastKeyframeUs_ >= keyframeIntervalUs_)
+    {
+      FrameCodec::EncodeKeyframe(buffer_, now, frame);
+      lastKeyframeUs_ = now;
+      width_ = frame.Width();
+      height_ = frame.Height();
+      needKeyframe_ = false;
+      flush();
+      return;
+    }
+
+    if (count == 0)
+      return;
+
+    FrameCodec::EncodeDelta(buffer_, now, spans, count);
+    if (buffer_.size() >= RConsole_RECORD_FLUSH_BYTES)
+      flush();
+  }
+
+  // Writes out what is buffered.
+  void FrameRecorder::flush()
+  {
+    if (!buffer_.empty())
+      fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    fflush(file_);
+    buffer_.clear();
+  }
+
+  ////////////////////
+ // Frame replayer //
+////////////////////
+// Constructor, with nothing loaded.
+  FrameReplayer::FrameReplayer()
+    : end_(0)
+    , offset_(0)
+    , timeUs_(0)
+    , durationUs_(0)
+    , frame_(0, 0)
+  {  }
+
+  // Loads a recording from a file.
+  bool FrameReplayer::Open(const char *path)
+  {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+      return false;
+
+    std::vector<char> contents;
+    char chunk[65536];
+    size_t got = 0;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+      contents.insert(contents.end(), chunk, chunk + got);
+    fclose(file);
+
+    return Load(contents.data(), contents.size());
+  }
+
+  // Loads a recording from memory, indexes its keyframes, and moves to its first frame.
+  bool FrameReplayer::Load(const char *data, size_t len)
+  {
+    if (!FrameCodec::CheckHeader(data, len))
+      return false;
+
+    data_.assign(data, data + len);
+    keyframes_.clear();
+    durationUs_ = 0;
+
+    size_t offset = FrameCodec::HeaderSize;
+    while (offset < len)
+    {
+      uint64_t timeUs = 0;
+      FrameKind kind = FRAME_DELTA;
+      const size_t size = FrameCodec::Peek(data_.data() + offset, len - offset, timeUs, kind);
+      if (size == 0 || size == FrameCodec::Malformed)
+        break;
+
+      if (kind == FRAME_KEY)
+      {
+        Keyframe keyframe = { offset, timeUs };
+        keyframes_.push_back(keyframe);
+      }
+      durationUs_ = timeUs;
+      offset += size;
+    }
+    end_ = offset;
+
+    if (keyframes_.empty())
+      return false;
+    return Seek(0);
+  }
+
+  // Time of the last frame, in microseconds.
+  uint64_t FrameReplayer::Duration() const
+  {
+    return durationUs_;
+  }
+
+  // Time of the current frame, in microseconds.
+  uint64_t FrameReplayer::Time() const
+  {
+    return timeUs_;
+  }
+
+  // Moves to the last frame at or before timeUs, or the first frame if it is earlier than that.
+  bool FrameReplayer::Seek(uint64_t timeUs)
+  {
+    if (keyframes_.empty())
+      return false;
+
+    // The last keyframe at or before the time, then forward from there.
+    std::vector<Keyframe>::const_iterator keyframe = std::upper_bound(keyframes_.begin(), keyframes_.end(), timeUs,
+      [](uint64_t time, const Keyframe &k) { return time < k.TimeUs; });
+    if (keyframe != keyframes_.begin())
+      --keyframe;
+
+    offset_ = keyframe->Offset;
+    Next();
+    while (offset_ < end_)
+    {
+      uint64_t nextUs = 0;
+      FrameKind kind = FRAME_DELTA;
+      FrameCodec::Peek(data_.data() + offset_, end_ - offset_, nextUs, kind);
+      if (nextUs > timeUs)
+        break;
+      Next();
+    }
+
+    return true;
+  }
+
+  // Moves to the next frame. Returns false at the end of the recording.
+  bool FrameReplayer::Next()
+  {
+    if (offset_ >= end_)
+      return false;
+
+    FrameKind kind = FRAME_DELTA;
+    const size_t size = FrameCodec::Decode(data_.data() + offset_, end_ - offset_, frame_, timeUs_, kind);
+    if (size == 0 || size == FrameCodec::Malformed)
+    {
+      offset_ = end_;
+      return false;
+    }
+
+    offset_ += size;
+    return true;
+  }
+
+  // The current frame. Empty cells are blank.
+  const Field2D<RasterInfo> &FrameReplayer::Frame() const
+  {
+    return frame_;
+  }
+
+  // Hands the current frame and every one after it to sink, paced to the times they were
+  // recorded at divided by speed. Stops at the end, or when the sink returns false.
+  void FrameReplayer::Play(const std::function<bool(const Field2D<RasterInfo> &, uint64_t)> &sink, double speed)
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const uint64_t startUs = timeUs_;
+
+    do
+    {
+      if (speed > 0)
+      {
+        const double waitUs = (timeUs_ - startUs) / speed;
+        std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(waitUs)));
+      }
+
+      if (!sink(frame_, timeUs_))
+        return;
+    } while (Next());
+  }
+
+  // Plays onto a canvas, one Update per frame.
+  void FrameReplayer::Play(Canvas &canvas, double speed)
+  {
+    Play([&canvas](const Field2D<RasterInfo> &frame, uint64_t)
+    {
+      canvas.Blit(frame, 0, 0);
+      return canvas.Update();
+    }, speed);
+  }
+}
+
+#endif
@@ -0,0 +1,229 @@
+#pragma once
+#ifndef SHADE_HPP
+#define SHADE_HPP
+
+// Includes
+#include <vector>           // Ramp glyphs for reverse lookups
+#include <utility>          // Glyph and intensity pairs
+#include <algorithm>        // Clamping, clipping and searching
+#include "Canvas.hpp"
+
+
+// Shading. Intensities from 0 to 255 are turned into cells through a lookup table built once
+// per ramp, so shading a span is a table lookup per cell followed by one bulk write.
+namespace RConsole
+{
+  // How new intensity combines with what a cell already shows.
+  enum ShadeBlend
+  {
+    SHADE_REPLACE,      // New intensity wins.
+    SHADE_MAX,          // Brightest of the two.
+    SHADE_ADD           // Sum of the two, saturating at full.
+  };
+
+  // A ramp of glyphs, and optionally colors, running from no intensity to full intensity.
+  // Glyphs split 0-255 into equal bands, as do colors, independently of each other. Ramps
+  // without colors use whatever color is passed in when drawing. Blending reads intensity back
+  // from glyphs on this ramp- anything else on the canvas counts as no intensity. The canvas
+  // clears every frame, so blending is between things shaded in the same frame.
+  class ShadeRamp
+  {
+  public:
+    // Constructors
+    ShadeRamp();
+    ShadeRamp(const Glyph *glyphs, size_t glyphCount);
+    ShadeRamp(const Glyph *glyphs, size_t glyphCount, const Color *colors, size_t colorCount);
+
+    // Lookups
+    Glyph GlyphFor(uint8_t intensity) const;
+    Color ColorFor(uint8_t intensity, Color fallback = PREVIOUS_COLOR) const;
+    uint8_t IntensityOf(Glyph glyph) const;
+    static uint8_t ToIntensity(float value);
+
+    // Drawing, clipped to the canvas.
+    void Fill(Canvas &canvas, uint8_t intensity, int x, int y, int w, int h, Color color = PREVIOUS_COLOR, ShadeBlend blend = SHADE_REPLACE) const;
+    void DrawSpan(Canvas &canvas, const uint8_t *intensities, unsigned int count, int x, int y, Color color = PREVIOUS_COLOR, ShadeBlend blend = SHADE_REPLACE) const;
+    void DrawSpan(Canvas &canvas, const float *intensities, unsigned int count, int x, int y, Color color = PREVIOUS_COLOR, ShadeBlend blend = SHADE_REPLACE) const;
+    void DrawField(Canvas &canvas, const Field2D<uint8_t> &intensities, int x, int y, Color color = PREVIOUS_COLOR, ShadeBlend blend = SHADE_REPLACE) const;
+    void DrawField(Canvas &canvas, const Field2D<float> &intensities, int x, int y, Color color = PREVIOUS_COLOR, ShadeBlend blend = SHADE_REPLACE) const;
+
+  private:
+    // Private member functions
+    void build(const Glyph *glyphs, size_t glyphCount, const Color *colors, size_t colorCount);
+
+    // Variables
+    Glyph glyphs_[256];
+    Color colors_[256];
+    bool hasColors_;
+    std::vector<std::pair<Glyph, uint8_t> > intensities_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  ////////////////
+ // Shade ramp //
+////////////////
+// Default constructor, a space followed by the four shade glyphs DrawAlpha uses.
+  ShadeRamp::ShadeRamp()
+  {
+    const Glyph glyphs[5] = { ' ', GLYPH_SHADE_LIGHT, GLYPH_SHADE_MEDIUM, GLYPH_SHADE_DARK, GLYPH_BLOCK_FULL };
+    build(glyphs, 5, nullptr, 0);
+  }
+
+  // A ramp of glyphs, drawn in whatever color is passed in.
+  ShadeRamp::ShadeRamp(const Glyph *glyphs, size_t glyphCount)
+  {
+    build(glyphs, glyphCount, nullptr, 0);
+  }
+
+  // A ramp of glyphs and a ramp of colors.
+  ShadeRamp::ShadeRamp(const Glyph *glyphs, size_t glyphCount, const Color *colors, size_t colorCount)
+  {
+    build(glyphs, glyphCount, colors, colorCount);
+  }
+
+  // The glyph that shows a given intensity.
+  Glyph ShadeRamp::GlyphFor(uint8_t intensity) const
+  {
+    return glyphs_[intensity];
+  }
+
+  // The color that shows a given intensity, or the fallback if the ramp has no colors.
+  Color ShadeRamp::ColorFor(uint8_t intensity, Color fallback) const
+  {
+    return hasColors_ ? colors_[intensity] : fallback;
+  }
+
+  // The lowest intensity that shows as the given glyph, so shading it again gives the same
+  // glyph back. Glyphs that aren't on the ramp have no intensity.
+  uint8_t ShadeRamp::IntensityOf(Glyph glyph) const
+  {
+    auto found = std::lower_bound(intensities_.begin(), intensities_.end(), std::make_pair(glyph, uint8_t(0)));
+    return (found != intensities_.end() && found->first == glyph) ? found->second : 0;
+  }
+
+  // Converts 0 to 1 into 0 to 255, clamping anything outside of that.
+  uint8_t ShadeRamp::ToIntensity(float value)
+  {
+    if (!(value > 0))
+      return 0;
+    if (value >= 1)
+      return 255;
+    return static_cast<uint8_t>(value * 255 + .5f);
+  }
+
+  // Shades a w by h rectangle with a single intensity.
+  void ShadeRamp::Fill(Canvas &canvas, uint8_t intensity, int x, int y, int w, int h, Color color, ShadeBlend blend) const
+  {
+    if (w <= 0 || h <= 0)
+      return;
+
+    std::vector<uint8_t> row(w, intensity);
+    for (int j = std::max(y, 0); j < y + h; ++j)
+      DrawSpan(canvas, row.data(), w, x, j, color, blend);
+  }
+
+  // Shades a run of cells along a row, one intensity per cell. Cells are built in batches from
+  // the lookup tables and handed to the canvas a batch at a time.
+  void ShadeRamp::DrawSpan(Canvas &canvas, const uint8_t *intensities, unsigned int count, int x, int y, Color color, ShadeBlend blend) const
+  {
+    // Bounds check.
+    if (y < 0) return;
+    if (static_cast<unsigned int>(y) >= canvas.GetConsoleHeight()) return;
+
+    // Clip on both sides.
+    if (x < 0)
+    {
+      if (static_cast<unsigned int>(-x) >= count) return;
+      intensities += -x;
+      count -= -x;
+      x = 0;
+    }
+    const unsigned int width = canvas.GetConsoleWidht();
+    if (static_cast<unsigned int>(x) >= width) return;
+    if (count > width - x) count = width - x;
+
+    const Field2DView<const RasterInfo> raster = canvas.GetRasterView();
+    const unsigned int batchSize = 128;
+    RasterInfo batch[batchSize];
+
+    for (unsigned int done = 0; done < count; done += batchSize)
+    {
+      const unsigned int n = std::min(batchSize, count - done);
+      const RasterInfo *existing = raster.RowData(y) + x + done;
+      for (unsigned int i = 0; i < n; ++i)
+      {
+        unsigned int value = intensities[done + i];
+        if (blend == SHADE_MAX)
+          value = std::max(value, static_cast<unsigned int>(IntensityOf(existing[i].Value)));
+        else if (blend == SHADE_ADD)
+          value = std::min(value + IntensityOf(existing[i].Value), 255u);
+
+        batch[i].Value = glyphs_[value];
+        batch[i].C = hasColors_ ? colors_[value] : color;
+      }
+
+      canvas.DrawCells(batch, n, x + done, y);
+    }
+  }
+
+  // Shades a run of cells from intensities between 0 and 1.
+  void ShadeRamp::DrawSpan(Canvas &canvas, const float *intensities, unsigned int count, int x, int y, Color color, ShadeBlend blend) const
+  {
+    const unsigned int batchSize = 128;
+    uint8_t batch[batchSize];
+
+    for (unsigned int done = 0; done < count; done += batchSize)
+    {
+      const unsigned int n = std::min(batchSize, count - done);
+      for (unsigned int i = 0; i < n; ++i)
+        batch[i] = ToIntensity(intensities[done + i]);
+
+      DrawSpan(canvas, batch, n, x + done, y, color, blend);
+    }
+  }
+
+  // Shades a whole field of intensities, such as a heatmap, with its top left corner at x, y.
+  void ShadeRamp::DrawField(Canvas &canvas, const Field2D<uint8_t> &intensities, int x, int y, Color color, ShadeBlend blend) const
+  {
+    for (unsigned int j = 0; j < intensities.Height(); ++j)
+      DrawSpan(canvas, intensities.Row(j), intensities.Width(), x, y + j, color, blend);
+  }
+
+  // Shades a whole field of intensities between 0 and 1 with its top left corner at x, y.
+  void ShadeRamp::DrawField(Canvas &canvas, const Field2D<float> &intensities, int x, int y, Color color, ShadeBlend blend) const
+  {
+    for (unsigned int j = 0; j < intensities.Height(); ++j)
+      DrawSpan(canvas, intensities.Row(j), intensities.Width(), x, y + j, color, blend);
+  }
+
+  // Builds the lookup tables. Glyph i of n covers intensities [i * 256 / n, (i + 1) * 256 / n).
+  // The reverse lookup is sorted by glyph so blending can binary search it, keeping only the
+  // lowest intensity of a glyph that shows up on the ramp more than once.
+  void ShadeRamp::build(const Glyph *glyphs, size_t glyphCount, const Color *colors, size_t colorCount)
+  {
+    hasColors_ = (colors != nullptr && colorCount > 0);
+
+    intensities_.clear();
+    for (size_t i = 0; i < glyphCount; ++i)
+      intensities_.push_back(std::make_pair(glyphs[i], static_cast<uint8_t>((i * 256 + glyphCount - 1) / glyphCount)));
+    std::sort(intensities_.begin(), intensities_.end());
+    intensities_.erase(std::unique(intensities_.begin(), intensities_.end(),
+      [](const std::pair<Glyph, uint8_t> &a, const std::pair<Glyph, uint8_t> &b) { return a.first == b.first; }), intensities_.end());
+
+    for (unsigned int i = 0; i < 256; ++i)
+    {
+      glyphs_[i] = glyphCount ? glyphs[i * glyphCount / 256] : GLYPH_EMPTY;
+      colors_[i] = hasColors_ ? colors[i * colorCount / 256] : PREVIOUS_COLOR;
+    }
+  }
+}
+
+#endif
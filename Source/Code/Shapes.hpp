@@ -0,0 +1,297 @@
+#pragma once
+#ifndef SHAPES_HPP
+#define SHAPES_HPP
+
+// Includes
+#include <vector>           // Polygon edge crossings
+#include <algorithm>        // Sorting crossings
+#include <cmath>            // Ellipse extents, polygon crossings
+#include "Canvas.hpp"
+
+
+// Shape rasterization. Everything here is clipped to the canvas and written as horizontal runs
+// through Canvas::DrawRun, so a shape costs per row it covers rather than per cell.
+namespace RConsole
+{
+  namespace Shapes
+  {
+    // A point on the canvas, in cells.
+    struct Point
+    {
+      Point(int x = 0, int y = 0);
+      int X;
+      int Y;
+    };
+
+    // Rectangles, w by h cells with the top left corner at x, y.
+    void Rect(Canvas &canvas, Glyph toWrite, int x, int y, int w, int h, Color color = PREVIOUS_COLOR);
+    void FillRect(Canvas &canvas, Glyph toWrite, int x, int y, int w, int h, Color color = PREVIOUS_COLOR);
+
+    // Lines, including both end points.
+    void Line(Canvas &canvas, Glyph toWrite, int x0, int y0, int x1, int y1, Color color = PREVIOUS_COLOR);
+
+    // Circles and ellipses around cx, cy. Cells are taller than they are wide in most fonts,
+    // so a circle will look like a tall ellipse- use Ellipse with rx about twice ry to compensate.
+    void Circle(Canvas &canvas, Glyph toWrite, int cx, int cy, int r, Color color = PREVIOUS_COLOR);
+    void FillCircle(Canvas &canvas, Glyph toWrite, int cx, int cy, int r, Color color = PREVIOUS_COLOR);
+    void Ellipse(Canvas &canvas, Glyph toWrite, int cx, int cy, int rx, int ry, Color color = PREVIOUS_COLOR);
+    void FillEllipse(Canvas &canvas, Glyph toWrite, int cx, int cy, int rx, int ry, Color color = PREVIOUS_COLOR);
+
+    // Polygons, closed from the last point back to the first. Filling uses the even-odd rule.
+    void Polygon(Canvas &canvas, Glyph toWrite, const Point *points, size_t count, Color color = PREVIOUS_COLOR);
+    void FillPolygon(Canvas &canvas, Glyph toWrite, const Point *points, size_t count, Color color = PREVIOUS_COLOR);
+
+    // Helpers
+    namespace _shapes_internal
+    {
+      int ellipseExtent(int rx, int ry, int dy);
+    }
+  }
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  namespace Shapes
+  {
+    ///////////
+   // Point //
+  ///////////
+  // Constructor
+    Point::Point(int x, int y) : X(x), Y(y)
+    {  }
+
+    ////////////////
+   // Rectangles //
+  ////////////////
+  // Outline of a rectangle: a run for the top and bottom rows, single cells down the sides.
+    void Rect(Canvas &canvas, Glyph toWrite, int x, int y, int w, int h, Color color)
+    {
+      if (w <= 0 || h <= 0)
+        return;
+
+      canvas.DrawRun(toWrite, x, y, w, color);
+      if (h == 1)
+        return;
+
+      canvas.DrawRun(toWrite, x, y + h - 1, w, color);
+      for (int j = y + 1; j < y + h - 1; ++j)
+      {
+        canvas.DrawRun(toWrite, x, j, 1, color);
+        if (w > 1)
+          canvas.DrawRun(toWrite, x + w - 1, j, 1, color);
+      }
+    }
+
+    // Filled rectangle, one run per row on the canvas.
+    void FillRect(Canvas &canvas, Glyph toWrite, int x, int y, int w, int h, Color color)
+    {
+      if (w <= 0 || h <= 0)
+        return;
+
+      const int top = std::max(y, 0);
+      const int bottom = std::min(y + h, static_cast<int>(canvas.GetConsoleHeight()));
+      for (int j = top; j < bottom; ++j)
+        canvas.DrawRun(toWrite, x, j, w, color);
+    }
+
+    ///////////
+   // Lines //
+  ///////////
+  // Bresenham line. Steps that stay on the same row are gathered up and drawn as one run.
+    void Line(Canvas &canvas, Glyph toWrite, int x0, int y0, int x1, int y1, Color color)
+    {
+      // Always walk left to right so runs grow to the right.
+      if (x0 > x1)
+      {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+      }
+
+      const int dx = x1 - x0;
+      const int dy = -std::abs(y1 - y0);
+      const int stepY = (y0 < y1) ? 1 : -1;
+      int error = dx + dy;
+      int runStart = x0;
+
+      while (true)
+      {
+        if (x0 == x1 && y0 == y1)
+          break;
+
+        const int doubled = 2 * error;
+        if (doubled >= dy)
+        {
+          error += dy;
+          ++x0;
+        }
+        if (doubled <= dx)
+        {
+          // Moving to a new row finishes the current run.
+          const int runEnd = (doubled >= dy) ? x0 - 1 : x0;
+          canvas.DrawRun(toWrite, runStart, y0, runEnd - runStart + 1, color);
+          error += dx;
+          y0 += stepY;
+          runStart = x0;
+        }
+      }
+
+      canvas.DrawRun(toWrite, runStart, y0, x0 - runStart + 1, color);
+    }
+
+    //////////////////////////
+   // Circles and Ellipses //
+  //////////////////////////
+  // Outline of a circle.
+    void Circle(Canvas &canvas, Glyph toWrite, int cx, int cy, int r, Color color)
+    {
+      Ellipse(canvas, toWrite, cx, cy, r, r, color);
+    }
+
+    // Filled circle.
+    void FillCircle(Canvas &canvas, Glyph toWrite, int cx, int cy, int r, Color color)
+    {
+      FillEllipse(canvas, toWrite, cx, cy, r, r, color);
+    }
+
+    // Outline of an ellipse. Each row covers the column nearest the curve, along with every
+    // column whose nearest row is this one, so both the steep sides and the flat top and
+    // bottom stay connected. The quarter is mirrored into the other three.
+    void Ellipse(Canvas &canvas, Glyph toWrite, int cx, int cy, int rx, int ry, Color color)
+    {
+      if (rx < 0 || ry < 0)
+        return;
+
+      std::vector<int> columnExtents(rx + 1);
+      for (int dx = 0; dx <= rx; ++dx)
+        columnExtents[dx] = _shapes_internal::ellipseExtent(ry, rx, dx);
+
+      for (int dy = 0; dy <= ry; ++dy)
+      {
+        int outer = _shapes_internal::ellipseExtent(rx, ry, dy);
+        int inner = outer;
+        for (int dx = 0; dx <= rx; ++dx)
+        {
+          if (columnExtents[dx] != dy)
+            continue;
+          inner = std::min(inner, dx);
+          outer = std::max(outer, dx);
+        }
+
+        const int rows[2] = { cy + dy, cy - dy };
+        for (int i = 0; i < (dy == 0 ? 1 : 2); ++i)
+        {
+          // Both sides meet in the middle, so draw it all as one run.
+          if (inner == 0)
+          {
+            canvas.DrawRun(toWrite, cx - outer, rows[i], 2 * outer + 1, color);
+            continue;
+          }
+
+          canvas.DrawRun(toWrite, cx - outer, rows[i], outer - inner + 1, color);
+          canvas.DrawRun(toWrite, cx + inner, rows[i], outer - inner + 1, color);
+        }
+      }
+    }
+
+    // Filled ellipse, one run per row.
+    void FillEllipse(Canvas &canvas, Glyph toWrite, int cx, int cy, int rx, int ry, Color color)
+    {
+      if (rx < 0 || ry < 0)
+        return;
+
+      for (int dy = 0; dy <= ry; ++dy)
+      {
+        const int extent = _shapes_internal::ellipseExtent(rx, ry, dy);
+        canvas.DrawRun(toWrite, cx - extent, cy + dy, 2 * extent + 1, color);
+        if (dy != 0)
+          canvas.DrawRun(toWrite, cx - extent, cy - dy, 2 * extent + 1, color);
+      }
+    }
+
+    //////////////
+   // Polygons //
+  //////////////
+  // Outline of a polygon, a line between each pair of neighboring points.
+    void Polygon(Canvas &canvas, Glyph toWrite, const Point *points, size_t count, Color color)
+    {
+      if (count == 0)
+        return;
+
+      for (size_t i = 0; i < count; ++i)
+      {
+        const Point &a = points[i];
+        const Point &b = points[(i + 1) % count];
+        Line(canvas, toWrite, a.X, a.Y, b.X, b.Y, color);
+      }
+    }
+
+    // Scanline polygon fill. Each row on the canvas is sampled through the middle of its cells,
+    // the edges it crosses are sorted, and the cells between each pair of crossings are one run.
+    void FillPolygon(Canvas &canvas, Glyph toWrite, const Point *points, size_t count, Color color)
+    {
+      if (count < 3)
+        return;
+
+      int top = points[0].Y;
+      int bottom = points[0].Y;
+      for (size_t i = 1; i < count; ++i)
+      {
+        top = std::min(top, points[i].Y);
+        bottom = std::max(bottom, points[i].Y);
+      }
+      top = std::max(top, 0);
+      bottom = std::min(bottom, static_cast<int>(canvas.GetConsoleHeight()) - 1);
+
+      std::vector<double> crossings;
+      crossings.reserve(count);
+      for (int y = top; y <= bottom; ++y)
+      {
+        const double sampleY = y + 0.5;
+        crossings.clear();
+        for (size_t i = 0; i < count; ++i)
+        {
+          const Point &a = points[i];
+          const Point &b = points[(i + 1) % count];
+          if ((a.Y <= sampleY) == (b.Y <= sampleY))
+            continue;
+
+          crossings.push_back(a.X + (sampleY - a.Y) * (b.X - a.X) / (b.Y - a.Y));
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // Cells whose middle falls between a pair of crossings are inside.
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+        {
+          const int start = static_cast<int>(std::ceil(crossings[i] - 0.5));
+          const int end = static_cast<int>(std::ceil(crossings[i + 1] - 0.5));
+          canvas.DrawRun(toWrite, start, y, end - start, color);
+        }
+      }
+    }
+
+    /////////////
+   // Helpers //
+  /////////////
+    namespace _shapes_internal
+    {
+      // How far out from the middle column an ellipse reaches dy rows from its middle row.
+      // Swap rx and ry to ask how far up from the middle row it reaches dy columns over.
+      int ellipseExtent(int rx, int ry, int dy)
+      {
+        if (ry == 0)
+          return rx;
+
+        const double t = static_cast<double>(dy) / ry;
+        return static_cast<int>(rx * std::sqrt(1.0 - t * t) + 0.5);
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,411 @@
+#pragma once
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+// Includes
+#include <vector>           // Cluster table
+#include <unordered_map>    // Remapping clusters
+#include <algorithm>        // Ordering the cluster table
+#include "Canvas.hpp"
+
+#ifdef OS_POSIX
+#include <sys/mman.h>       // Mapping snapshots
+#include <sys/stat.h>
+#endif
+
+
+// Snapshots of cells, stored the way a Field2D<RasterInfo> lays them out in memory so saving is
+// a single write and opening is mapping the file and pointing at it.
+//
+// A snapshot is a 64 byte header, the palette its colors index, a table of the grapheme clusters
+// its cells use, then the cells row by row starting on a 64 byte boundary. Everything is in the
+// byte order of the machine that saved it, which the header records. Palette entries are
+// 0xRRGGBB. Each cluster is the glyph its cells were saved with, its byte length, then its UTF-8
+// padded out to 4 bytes.
+namespace RConsole
+{
+  // Layouts cells can be stored in.
+  enum SnapshotCellFormat
+  {
+    SNAPSHOT_CELLS_RASTERINFO = 1   // A 32 bit glyph then a 32 bit color, as RasterInfo.
+  };
+
+  // The start of every snapshot file.
+  struct SnapshotHeader
+  {
+    char Magic[8];            // "RCSNAP01"
+    uint32_t Version;
+    uint32_t ByteOrder;       // 0x01020304 as the saving machine wrote it.
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t CellFormat;      // A SnapshotCellFormat.
+    uint32_t CellSize;
+    uint32_t PaletteOffset;
+    uint32_t PaletteCount;
+    uint32_t ClusterOffset;
+    uint32_t ClusterCount;
+    uint64_t CellOffset;
+    uint64_t FileSize;
+  };
+
+  // A snapshot file opened for reading. The file is mapped rather than read, so opening costs
+  // the same however big it is, and the cells can be blitted straight from the mapping. The one
+  // exception is a snapshot whose clusters were interned under different glyphs in this process
+  // than the one that saved it: its cells are copied once with the glyphs fixed up.
+  class Snapshot
+  {
+  public:
+    // Constructor
+    Snapshot();
+    ~Snapshot();
+
+    // Static member functions
+    static bool Save(const char *path, Field2DView<const RasterInfo> cells);
+
+    // Reading
+    bool Open(const char *path);
+    void Close();
+    bool IsOpen() const;
+    bool IsMapped() const;
+
+    // Contents
+    unsigned int Width() const;
+    unsigned int Height() const;
+    Field2DView<const RasterInfo> Cells() const;
+    uint32_t PaletteColor(Color color) const;
+
+    // Format
+    static const uint32_t Version = 1;
+    static const uint32_t ByteOrder = 0x01020304;
+    static const size_t CellAlignment = 64;
+
+  private:
+    // Hidden Constructors
+    Snapshot(const Snapshot &rhs);
+    Snapshot &operator=(const Snapshot &rhs);
+
+    // Private methods.
+    bool load();
+    bool loadClusters();
+
+    // Variables
+    const char *data_;
+    size_t size_;
+#ifdef OS_WINDOWS
+    HANDLE mapping_;
+#endif
+    SnapshotHeader header_;
+    Field2DView<const RasterInfo> cells_;
+    Field2D<RasterInfo> remapped_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  static_assert(sizeof(SnapshotHeader) == 64, "Snapshot headers are 64 bytes");
+  static_assert(sizeof(RasterInfo) == 8, "Snapshots store cells as 8 bytes");
+
+  //////////////
+ // Snapshot //
+//////////////
+// Constructor, nothing is open until Open.
+  Snapshot::Snapshot()
+    : data_(nullptr)
+    , size_(0)
+#ifdef OS_WINDOWS
+    , mapping_(NULL)
+#endif
+    , header_()
+    , cells_()
+    , remapped_(0, 0)
+  {  }
+
+  // Unmaps the file.
+  Snapshot::~Snapshot()
+  {
+    Close();
+  }
+
+  // Saves cells to path. The file is written next to path and renamed over it once complete, so
+  // a snapshot someone has open is never changed under them. Returns false if it couldn't be.
+  bool Snapshot::Save(const char *path, Field2DView<const RasterInfo> cells)
+  {
+    static const uint32_t palette[16] =
+    {
+      0x000000, 0x0000aa, 0x00aa00, 0x00aaaa, 0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+      0x555555, 0x5555ff, 0x55ff55, 0x55ffff, 0xff5555, 0xff55ff, 0xffff55, 0xffffff
+    };
+
+    // Clusters in glyph order, so a process that interns them in that order gets the same glyphs.
+    std::vector<Glyph> clusters;
+    for (unsigned int y = 0; y < cells.Height(); ++y)
+    {
+      const RasterInfo *row = cells.RowData(y);
+      for (unsigned int x = 0; x < cells.Width(); ++x)
+        if ((row[x].Value & GLYPH_INTERNED) && (clusters.empty() || clusters.back() != row[x].Value))
+          clusters.push_back(row[x].Value);
+    }
+    std::sort(clusters.begin(), clusters.end());
+    clusters.erase(std::unique(clusters.begin(), clusters.end()), clusters.end());
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, "RCSNAP01", 8);
+    header.Version = Version;
+    header.ByteOrder = ByteOrder;
+    header.Width = cells.Width();
+    header.Height = cells.Height();
+    header.CellFormat = SNAPSHOT_CELLS_RASTERINFO;
+    header.CellSize = sizeof(RasterInfo);
+    header.PaletteOffset = sizeof(SnapshotHeader);
+    header.PaletteCount = 16;
+    header.ClusterOffset = header.PaletteOffset + sizeof(palette);
+    header.ClusterCount = static_cast<uint32_t>(clusters.size());
+
+    // Everything before the cells goes in one buffer.
+    std::string head(header.ClusterOffset, '\0');
+    memcpy(&head[header.PaletteOffset], palette, sizeof(palette));
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+      size_t length = 0;
+      const char *bytes = GraphemePool::Bytes(clusters[i], length);
+      const uint32_t entry[2] = { clusters[i], static_cast<uint32_t>(length) };
+      head.append(reinterpret_cast<const char *>(entry), sizeof(entry));
+      head.append(bytes, length);
+      head.append((4 - length % 4) % 4, '\0');
+    }
+    head.append((CellAlignment - head.size() % CellAlignment) % CellAlignment, '\0');
+
+    const size_t rowBytes = static_cast<size_t>(cells.Width()) * sizeof(RasterInfo);
+    header.CellOffset = head.size();
+    header.FileSize = header.CellOffset + rowBytes * cells.Height();
+    memcpy(&head[0], &header, sizeof(header));
+
+    const std::string temporary = std::string(path) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+      return false;
+
+    bool written = fwrite(head.data(), 1, head.size(), file) == head.size();
+    if (!cells.Empty() && (cells.Stride() == cells.Width() || cells.Height() == 1))
+      written = written && fwrite(cells.RowData(0), 1, rowBytes * cells.Height(), file) == rowBytes * cells.Height();
+    else
+      for (unsigned int y = 0; y < cells.Height() && written; ++y)
+        written = fwrite(cells.RowData(y), 1, rowBytes, file) == rowBytes;
+    written = (fclose(file) == 0) && written;
+
+#ifdef OS_WINDOWS
+    if (written)
+      remove(path);
+#endif
+    if (!written || rename(temporary.c_str(), path) != 0)
+    {
+      remove(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Maps the snapshot at path, replacing whatever was open. Returns false if it isn't there or
+  // isn't a snapshot this build can read.
+  bool Snapshot::Open(const char *path)
+  {
+    Close();
+#ifdef OS_POSIX
+    const int file = open(path, O_RDONLY | O_CLOEXEC);
+    if (file == -1)
+      return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+    {
+      ::close(file);
+      return false;
+    }
+
+    // The mapping keeps the file alive on its own.
+    void *mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapped == MAP_FAILED)
+      return false;
+    data_ = static_cast<const char *>(mapped);
+    size_ = static_cast<size_t>(info.st_size);
+#elif defined(OS_WINDOWS)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(SnapshotHeader)))
+    {
+      CloseHandle(file);
+      return false;
+    }
+
+    mapping_ = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping_ == NULL)
+      return false;
+    data_ = static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr)
+    {
+      CloseHandle(mapping_);
+      mapping_ = NULL;
+      return false;
+    }
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    UNUSED(path);
+    return false;
+#endif
+
+    if (!load())
+    {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  // Unmaps the file and lets go of any remapped cells.
+  void Snapshot::Close()
+  {
+    if (data_ != nullptr)
+    {
+#ifdef OS_POSIX
+      munmap(const_cast<char *>(data_), size_);
+#elif defined(OS_WINDOWS)
+      UnmapViewOfFile(data_);
+      CloseHandle(mapping_);
+      mapping_ = NULL;
+#endif
+    }
+
+    data_ = nullptr;
+    size_ = 0;
+    memset(&header_, 0, sizeof(header_));
+    cells_ = Field2DView<const RasterInfo>();
+    remapped_.Resize(0, 0);
+  }
+
+  // Whether a snapshot is open.
+  bool Snapshot::IsOpen() const
+  {
+    return data_ != nullptr;
+  }
+
+  // Whether the cells are being read straight from the file, rather than a remapped copy.
+  bool Snapshot::IsMapped() const
+  {
+    return data_ != nullptr && remapped_.Width() == 0;
+  }
+
+  // Width of the snapshot in cells.
+  unsigned int Snapshot::Width() const
+  {
+    return header_.Width;
+  }
+
+  // Height of the snapshot in cells.
+  unsigned int Snapshot::Height() const
+  {
+    return header_.Height;
+  }
+
+  // The cells, ready to blit. Only good until the snapshot is closed.
+  Field2DView<const RasterInfo> Snapshot::Cells() const
+  {
+    return cells_;
+  }
+
+  // The 0xRRGGBB the saving machine showed a color as, or 0 for colors it had no entry for.
+  uint32_t Snapshot::PaletteColor(Color color) const
+  {
+    if (data_ == nullptr || color < 0 || static_cast<uint32_t>(color) >= header_.PaletteCount)
+      return 0;
+
+    uint32_t value = 0;
+    memcpy(&value, data_ + header_.PaletteOffset + static_cast<size_t>(color) * sizeof(uint32_t), sizeof(value));
+    return value;
+  }
+
+  // Checks the header against what's mapped and points the cells at it.
+  bool Snapshot::load()
+  {
+    memcpy(&header_, data_, sizeof(header_));
+    if (memcmp(header_.Magic, "RCSNAP01", 8) != 0 || header_.Version != Version || header_.ByteOrder != ByteOrder)
+      return false;
+    if (header_.CellFormat != SNAPSHOT_CELLS_RASTERINFO || header_.CellSize != sizeof(RasterInfo))
+      return false;
+
+    // Every part has to be in the file, and the cells have to be aligned to be used in place.
+    const uint64_t cellBytes = static_cast<uint64_t>(header_.Width) * header_.Height * sizeof(RasterInfo);
+    if (header_.FileSize > size_ || header_.CellOffset > size_ || cellBytes > size_ - header_.CellOffset)
+      return false;
+    if (header_.CellOffset % alignof(RasterInfo) != 0)
+      return false;
+    if (header_.PaletteOffset > size_ || static_cast<uint64_t>(header_.PaletteCount) * sizeof(uint32_t) > size_ - header_.PaletteOffset)
+      return false;
+
+    const RasterInfo *cells = reinterpret_cast<const RasterInfo *>(data_ + header_.CellOffset);
+    cells_ = Field2DView<const RasterInfo>(cells, header_.Width, header_.Height, header_.Width);
+    return loadClusters();
+  }
+
+  // Interns the clusters the snapshot uses. If any come out as different glyphs than they were
+  // saved as, the cells are copied with their glyphs swapped for this process's.
+  bool Snapshot::loadClusters()
+  {
+    std::unordered_map<Glyph, Glyph> listed;
+    bool same = true;
+    size_t offset = header_.ClusterOffset;
+    for (uint32_t i = 0; i < header_.ClusterCount; ++i)
+    {
+      uint32_t entry[2];
+      if (offset > size_ || size_ - offset < sizeof(entry))
+        return false;
+      memcpy(entry, data_ + offset, sizeof(entry));
+      offset += sizeof(entry);
+      if (entry[1] == 0 || entry[1] > size_ - offset)
+        return false;
+
+      const Glyph glyph = GraphemePool::Intern(data_ + offset, entry[1]);
+      listed[entry[0]] = glyph;
+      same = same && glyph == entry[0];
+      offset += entry[1] + (4 - entry[1] % 4) % 4;
+    }
+
+    // Mapped cells are used as they are, without checking every glyph. An interned glyph the
+    // file didn't list is past the end of the pool at worst, which the pool shows as '?'.
+    if (same)
+      return true;
+
+    // Anything interned that wasn't listed can't be shown, so it becomes a question mark.
+    remapped_.Resize(header_.Width, header_.Height);
+    for (unsigned int y = 0; y < header_.Height; ++y)
+    {
+      const RasterInfo *from = cells_.RowData(y);
+      RasterInfo *to = remapped_.Row(y);
+      for (unsigned int x = 0; x < header_.Width; ++x)
+      {
+        to[x] = from[x];
+        if (from[x].Value & GLYPH_INTERNED)
+        {
+          auto found = listed.find(from[x].Value);
+          to[x].Value = (found != listed.end()) ? found->second : static_cast<Glyph>('?');
+        }
+      }
+    }
+
+    cells_ = remapped_.View();
+    return true;
+  }
+}
+
+#endif
@@ -0,0 +1,277 @@
+#pragma once
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+// Includes
+#include <vector>           // Connected viewers
+#include <chrono>           // Frame timestamps
+#include "Recording.hpp"
+
+#ifdef OS_POSIX
+#include <sys/socket.h>     // Unix domain sockets
+#include <sys/un.h>
+#include <fcntl.h>          // Non-blocking sockets
+#include <cerrno>
+#endif
+
+
+// Streaming frames to other processes. The stream is the same format recordings use, so a
+// viewer can render it, or save it straight to a file to replay later.
+namespace RConsole
+{
+  // Sends the frames of the canvases it observes to every viewer connected to a Unix domain
+  // socket. New viewers get a keyframe first and deltas after that. Sockets never block: a
+  // viewer that can't take a frame yet has it dropped, along with any after it, until it has
+  // caught up, and is then sent a fresh keyframe. The canvas doesn't need a terminal of its own
+  // for this- its output can go to /dev/null. Only available on POSIX systems.
+  class FrameStreamServer : public FrameObserver
+  {
+  public:
+    // Constructor
+    FrameStreamServer();
+    ~FrameStreamServer();
+
+    // Serving
+    bool Listen(const char *path);
+    void Close();
+    bool IsListening() const;
+    size_t ViewerCount() const;
+    void OnFrame(const Canvas &canvas, const FrameSpan *spans, size_t count);
+
+  private:
+    // A connected viewer, and whatever part of a record it hasn't taken yet.
+    struct Viewer
+    {
+      int Socket;
+      std::string Pending;
+      bool NeedsKeyframe;
+    };
+
+    // Hidden Constructors
+    FrameStreamServer(const FrameStreamServer &rhs);
+    FrameStreamServer &operator=(const FrameStreamServer &rhs);
+
+    // Private methods.
+    void acceptViewers();
+    bool send(Viewer &viewer, const std::string &data);
+
+    // Variables
+    int socket_;
+    std::string path_;
+    std::vector<Viewer> viewers_;
+    std::string keyframe_;
+    std::string delta_;
+    std::chrono::steady_clock::time_point start_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  /////////////////////////
+ // Frame stream server //
+/////////////////////////
+// Constructor, nothing is served until Listen.
+  FrameStreamServer::FrameStreamServer()
+    : socket_(-1)
+  {  }
+
+  // Disconnects every viewer and removes the socket.
+  FrameStreamServer::~FrameStreamServer()
+  {
+    Close();
+  }
+
+  // Starts listening at path, replacing any socket already there.
+  bool FrameStreamServer::Listen(const char *path)
+  {
+    Close();
+#ifdef OS_POSIX
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+      return false;
+    strcpy(address.sun_path, path);
+
+    socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_ == -1)
+      return false;
+
+    unlink(path);
+    if (bind(socket_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 || listen(socket_, 8) != 0)
+    {
+      ::close(socket_);
+      socket_ = -1;
+      return false;
+    }
+
+    fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK);
+    fcntl(socket_, F_SETFD, FD_CLOEXEC);
+    path_ = path;
+    start_ = std::chrono::steady_clock::now();
+    return true;
+#else
+    UNUSED(path);
+    return false;
+#endif
+  }
+
+  // Stops serving.
+  void FrameStreamServer::Close()
+  {
+#ifdef OS_POSIX
+    for (size_t i = 0; i < viewers_.size(); ++i)
+      ::close(viewers_[i].Socket);
+    viewers_.clear();
+
+    if (socket_ != -1)
+    {
+      ::close(socket_);
+      unlink(path_.c_str());
+      socket_ = -1;
+    }
+#endif
+  }
+
+  // Whether the socket is up.
+  bool FrameStreamServer::IsListening() const
+  {
+    return socket_ != -1;
+  }
+
+  // How many viewers are connected.
+  size_t FrameStreamServer::ViewerCount() const
+  {
+    return viewers_.size();
+  }
+
+  // Sends a frame to every viewer that can take it. The keyframe and delta are each encoded at
+  // most once, however many viewers there are.
+  void FrameStreamServer::OnFrame(const Canvas &canvas, const FrameSpan *spans, size_t count)
+  {
+    if (socket_ == -1)
+      return;
+
+    acceptViewers();
+    if (viewers_.empty())
+      return;
+
+    const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    keyframe_.clear();
+    delta_.clear();
+
+    size_t i = 0;
+    while (i < viewers_.size())
+    {
+      Viewer &viewer = viewers_[i];
+
+      // Finish off the last record first. If that can't be done, this frame is dropped.
+      bool connected = true;
+      if (!viewer.Pending.empty())
+        connected = send(viewer, viewer.Pending);
+
+      if (connected && viewer.Pending.empty())
+      {
+        if (viewer.NeedsKeyframe)
+        {
+          if (keyframe_.empty())
+            FrameCodec::EncodeKeyframe(keyframe_, now, canvas.GetRasterView());
+          viewer.NeedsKeyframe = false;
+          connected = send(viewer, keyframe_);
+        }
+        else if (count > 0)
+        {
+          if (delta_.empty())
+            FrameCodec::EncodeDelta(delta_, now, spans, count);
+          connected = send(viewer, delta_);
+        }
+      }
+      else if (connected)
+      {
+        // Frames have been dropped, so deltas no longer apply.
+        viewer.NeedsKeyframe = true;
+      }
+
+      if (!connected)
+      {
+        ::close(viewer.Socket);
+        viewers_.erase(viewers_.begin() + i);
+        continue;
+      }
+      ++i;
+    }
+  }
+
+  // Takes on every viewer waiting to connect, and starts each with the stream header.
+  void FrameStreamServer::acceptViewers()
+  {
+#ifdef OS_POSIX
+    while (true)
+    {
+      const int client = accept(socket_, nullptr, nullptr);
+      if (client == -1)
+        return;
+
+      fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+      fcntl(client, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+      const int on = 1;
+      setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+      Viewer viewer;
+      viewer.Socket = client;
+      viewer.NeedsKeyframe = true;
+      FrameCodec::WriteHeader(viewer.Pending);
+      viewers_.push_back(viewer);
+    }
+#endif
+  }
+
+  // Sends data without blocking. Whatever doesn't fit is kept as the viewer's pending record.
+  // Returns false if the viewer has gone away.
+  bool FrameStreamServer::send(Viewer &viewer, const std::string &data)
+  {
+#ifdef OS_POSIX
+    size_t offset = 0;
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (offset < data.size())
+    {
+      const ssize_t sent = ::send(viewer.Socket, data.data() + offset, data.size() - offset, flags);
+      if (sent > 0)
+      {
+        offset += static_cast<size_t>(sent);
+        continue;
+      }
+      if (sent == -1 && errno == EINTR)
+        continue;
+      if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      return false;
+    }
+
+    // Keep the rest for next frame, unless it is already what's pending.
+    if (&data != &viewer.Pending)
+      viewer.Pending.assign(data, offset, std::string::npos);
+    else
+      viewer.Pending.erase(0, offset);
+    return true;
+#else
+    UNUSED(viewer);
+    UNUSED(data);
+    return false;
+#endif
+  }
+}
+
+#endif
@@ -0,0 +1,412 @@
+#pragma once
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+// Includes
+#include <vector>           // Laid out lines
+#include <unordered_map>    // Layout cache
+#include <algorithm>        // Widest line, eviction
+#include "Canvas.hpp"
+
+// Most layouts a TextCache keeps before dropping the ones used longest ago.
+#ifndef RConsole_TEXT_CACHE_SIZE
+#define RConsole_TEXT_CACHE_SIZE 256
+#endif
+
+
+// Laying out text in a box: wrapping, alignment and truncation. A layout only records where
+// each line starts and ends in the text, so drawing it is a span write per line.
+namespace RConsole
+{
+  // How text too long for a line is broken up.
+  enum TextWrap
+  {
+    TEXT_WRAP_WORD,     // Between words, or inside a word too long for a line on its own.
+    TEXT_WRAP_CHAR,     // At whatever glyph reaches the edge.
+    TEXT_WRAP_NONE      // Not at all- lines are cut short with an ellipsis.
+  };
+
+  // Where lines sit within the width they were laid out to.
+  enum TextAlign
+  {
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT
+  };
+
+  // One laid out line: a range of bytes in the text, the cells it covers, and whether it was
+  // cut short and ends in an ellipsis.
+  struct TextLine
+  {
+    size_t Offset;
+    size_t Length;
+    unsigned int Width;
+    bool Ellipsis;
+  };
+
+  // Text broken into lines that fit a width. Newlines always break, and a width of 0 doesn't
+  // limit lines at all. With a line limit, the last line left ends in an ellipsis if there was
+  // more text. Lines refer back into the text, so it has to be passed again to draw them.
+  class TextLayout
+  {
+  public:
+    // Constructor
+    TextLayout();
+
+    // Layout
+    void Layout(const char *text, size_t len, unsigned int width, TextWrap wrap = TEXT_WRAP_WORD, unsigned int maxLines = 0);
+    const std::vector<TextLine> &Lines() const;
+    unsigned int Width() const;
+    unsigned int Height() const;
+
+    // Drawing. Returns how many rows were drawn to.
+    unsigned int Draw(Canvas &canvas, const char *text, int x, int y, TextAlign align = TEXT_ALIGN_LEFT, Color color = PREVIOUS_COLOR) const;
+
+  private:
+    // Private methods.
+    void addLine(size_t offset, size_t length, unsigned int width);
+    void truncate(const char *text, TextLine &line);
+
+    // Variables
+    std::vector<TextLine> lines_;
+    unsigned int width_;
+    unsigned int limit_;
+  };
+
+  // Layouts kept by the text they were made for, so paragraphs that haven't changed aren't laid
+  // out again each frame. Text is looked up by where it is and how long it is, then checked
+  // against a copy, so text edited in place is laid out again too. When full, the layouts used
+  // longest ago are dropped.
+  class TextCache
+  {
+  public:
+    // Constructor
+    TextCache(size_t capacity = RConsole_TEXT_CACHE_SIZE);
+
+    // Layout
+    const TextLayout &Layout(const char *text, size_t len, unsigned int width, TextWrap wrap = TEXT_WRAP_WORD, unsigned int maxLines = 0);
+    unsigned int Draw(Canvas &canvas, const char *text, size_t len, int x, int y, unsigned int width, TextAlign align = TEXT_ALIGN_LEFT, Color color = PREVIOUS_COLOR, TextWrap wrap = TEXT_WRAP_WORD, unsigned int maxLines = 0);
+    unsigned int Draw(Canvas &canvas, const std::string &text, int x, int y, unsigned int width, TextAlign align = TEXT_ALIGN_LEFT, Color color = PREVIOUS_COLOR, TextWrap wrap = TEXT_WRAP_WORD, unsigned int maxLines = 0);
+
+    // Cache
+    size_t Count() const;
+    void Clear();
+
+  private:
+    // What a layout was made for.
+    struct Key
+    {
+      const char *Text;
+      size_t Length;
+      unsigned int Width;
+      unsigned int MaxLines;
+      TextWrap Wrap;
+      bool operator ==(const Key &rhs) const;
+    };
+
+    struct KeyHash
+    {
+      size_t operator()(const Key &key) const;
+    };
+
+    // A layout, the text it was made from, and when it was last used.
+    struct Entry
+    {
+      TextLayout Layout;
+      std::string Text;
+      uint64_t Used;
+    };
+
+    // Private methods.
+    void evict();
+
+    // Variables
+    std::unordered_map<Key, Entry, KeyHash> layouts_;
+    size_t capacity_;
+    uint64_t clock_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  // U+2026, what cut off lines end in.
+  const Glyph GLYPH_ELLIPSIS = 0x2026;
+
+  /////////////////
+ // Text layout //
+/////////////////
+// Constructor, starts out with no lines.
+  TextLayout::TextLayout()
+    : lines_()
+    , width_(0)
+    , limit_(0)
+  {  }
+
+  // Breaks text into lines no wider than width. Spaces a line was broken at are dropped, so
+  // lines don't start or end with them after wrapping.
+  void TextLayout::Layout(const char *text, size_t len, unsigned int width, TextWrap wrap, unsigned int maxLines)
+  {
+    lines_.clear();
+    width_ = 0;
+    limit_ = width;
+
+    size_t read = 0;
+    while (read < len)
+    {
+      if (maxLines != 0 && lines_.size() == maxLines)
+      {
+        truncate(text, lines_.back());
+        break;
+      }
+
+      // Walk the line until it ends or runs out of room, remembering the last place a word ended.
+      const size_t start = read;
+      unsigned int used = 0;
+      size_t wordEnd = start;
+      unsigned int wordWidth = 0;
+      size_t nextWord = start;
+      bool full = false;
+      while (read < len && text[read] != '\n')
+      {
+        Glyph glyph = GLYPH_EMPTY;
+        const size_t size = DecodeGlyph(text + read, len - read, glyph);
+        const unsigned int cells = GlyphWidth(glyph);
+        if (glyph == ' ')
+        {
+          if (read == start || text[read - 1] != ' ')
+          {
+            wordEnd = read;
+            wordWidth = used;
+          }
+          nextWord = read + size;
+        }
+
+        if (width != 0 && used + cells > width && used != 0)
+        {
+          full = true;
+          break;
+        }
+        used += cells;
+        read += size;
+      }
+
+      if (!full)
+      {
+        addLine(start, read - start, used);
+        read += (read < len);
+      }
+      else if (wrap == TEXT_WRAP_NONE)
+      {
+        addLine(start, read - start, used);
+        truncate(text, lines_.back());
+        while (read < len && text[read++] != '\n') {  }
+      }
+      else if (wrap == TEXT_WRAP_WORD && wordEnd > start)
+      {
+        addLine(start, wordEnd - start, wordWidth);
+        read = nextWord;
+      }
+      else
+      {
+        addLine(start, read - start, used);
+      }
+
+      // Lines broken by wrapping don't start with the spaces they were broken at.
+      if (full && wrap != TEXT_WRAP_NONE)
+        while (read < len && text[read] == ' ')
+          ++read;
+    }
+  }
+
+  // The laid out lines, top to bottom.
+  const std::vector<TextLine> &TextLayout::Lines() const
+  {
+    return lines_;
+  }
+
+  // Cells covered by the widest line, ellipsis included.
+  unsigned int TextLayout::Width() const
+  {
+    return width_;
+  }
+
+  // Number of lines.
+  unsigned int TextLayout::Height() const
+  {
+    return static_cast<unsigned int>(lines_.size());
+  }
+
+  // Draws the lines of text onto a canvas, each as one span, aligned within the width it was
+  // laid out to (or the widest line, if that was unlimited). Text has to be what was laid out.
+  unsigned int TextLayout::Draw(Canvas &canvas, const char *text, int x, int y, TextAlign align, Color color) const
+  {
+    const unsigned int box = (limit_ != 0) ? limit_ : width_;
+    for (size_t i = 0; i < lines_.size(); ++i)
+    {
+      const TextLine &line = lines_[i];
+      const unsigned int cells = line.Width + (line.Ellipsis ? 1 : 0);
+      int left = x;
+      if (cells < box && align == TEXT_ALIGN_CENTER)
+        left += static_cast<int>((box - cells) / 2);
+      else if (cells < box && align == TEXT_ALIGN_RIGHT)
+        left += static_cast<int>(box - cells);
+
+      const int row = y + static_cast<int>(i);
+      canvas.DrawSpan(text + line.Offset, line.Length, left, row, color);
+      if (line.Ellipsis)
+        canvas.DrawGlyph(GLYPH_ELLIPSIS, left + static_cast<int>(line.Width), row, color);
+    }
+    return static_cast<unsigned int>(lines_.size());
+  }
+
+  // Adds a line that fits.
+  void TextLayout::addLine(size_t offset, size_t length, unsigned int width)
+  {
+    TextLine line;
+    line.Offset = offset;
+    line.Length = length;
+    line.Width = width;
+    line.Ellipsis = false;
+    lines_.push_back(line);
+    width_ = std::max(width_, width);
+  }
+
+  // Ends a line in an ellipsis, dropping as much of its end as it takes to fit it in.
+  void TextLayout::truncate(const char *text, TextLine &line)
+  {
+    line.Ellipsis = true;
+    if (limit_ == 0 || line.Width + 1 <= limit_)
+    {
+      width_ = std::max(width_, line.Width + 1);
+      return;
+    }
+
+    size_t read = 0;
+    unsigned int used = 0;
+    while (read < line.Length)
+    {
+      Glyph glyph = GLYPH_EMPTY;
+      const size_t size = DecodeGlyph(text + line.Offset + read, line.Length - read, glyph);
+      if (used + GlyphWidth(glyph) + 1 > limit_)
+        break;
+      used += GlyphWidth(glyph);
+      read += size;
+    }
+
+    // Trailing spaces before an ellipsis look like a gap.
+    while (read > 0 && text[line.Offset + read - 1] == ' ')
+    {
+      --read;
+      --used;
+    }
+    line.Length = read;
+    line.Width = used;
+    width_ = std::max(width_, used + 1);
+  }
+
+  ////////////////
+ // Text cache //
+////////////////
+// Constructor, keeps up to capacity layouts.
+  TextCache::TextCache(size_t capacity)
+    : layouts_()
+    , capacity_(capacity > 0 ? capacity : 1)
+    , clock_(0)
+  {  }
+
+  // Gets the layout for text, laying it out only if it isn't cached or has changed.
+  const TextLayout &TextCache::Layout(const char *text, size_t len, unsigned int width, TextWrap wrap, unsigned int maxLines)
+  {
+    Key key;
+    key.Text = text;
+    key.Length = len;
+    key.Width = width;
+    key.MaxLines = maxLines;
+    key.Wrap = wrap;
+
+    auto found = layouts_.find(key);
+    if (found == layouts_.end())
+    {
+      if (layouts_.size() >= capacity_)
+        evict();
+      found = layouts_.insert(std::make_pair(key, Entry())).first;
+      found->second.Layout.Layout(text, len, width, wrap, maxLines);
+      found->second.Text.assign(text, len);
+    }
+    else if (len != 0 && memcmp(found->second.Text.data(), text, len) != 0)
+    {
+      found->second.Layout.Layout(text, len, width, wrap, maxLines);
+      found->second.Text.assign(text, len);
+    }
+
+    found->second.Used = ++clock_;
+    return found->second.Layout;
+  }
+
+  // Lays out text to width, through the cache, and draws it at x, y. Returns how many rows were
+  // drawn to.
+  unsigned int TextCache::Draw(Canvas &canvas, const char *text, size_t len, int x, int y, unsigned int width, TextAlign align, Color color, TextWrap wrap, unsigned int maxLines)
+  {
+    return Layout(text, len, width, wrap, maxLines).Draw(canvas, text, x, y, align, color);
+  }
+
+  // Lays out a string to width, through the cache, and draws it at x, y.
+  unsigned int TextCache::Draw(Canvas &canvas, const std::string &text, int x, int y, unsigned int width, TextAlign align, Color color, TextWrap wrap, unsigned int maxLines)
+  {
+    return Draw(canvas, text.data(), text.size(), x, y, width, align, color, wrap, maxLines);
+  }
+
+  // How many layouts are cached.
+  size_t TextCache::Count() const
+  {
+    return layouts_.size();
+  }
+
+  // Drops every layout.
+  void TextCache::Clear()
+  {
+    layouts_.clear();
+  }
+
+  // Drops the older half of the layouts, so a full cache isn't scanned on every miss.
+  void TextCache::evict()
+  {
+    std::vector<uint64_t> used;
+    used.reserve(layouts_.size());
+    for (auto it = layouts_.begin(); it != layouts_.end(); ++it)
+      used.push_back(it->second.Used);
+
+    std::nth_element(used.begin(), used.begin() + used.size() / 2, used.end());
+    const uint64_t cutoff = used[used.size() / 2];
+    for (auto it = layouts_.begin(); it != layouts_.end(); )
+    {
+      if (it->second.Used <= cutoff)
+        it = layouts_.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  // Keys match when they're the same text, laid out the same way.
+  bool TextCache::Key::operator ==(const Key &rhs) const
+  {
+    return Text == rhs.Text && Length == rhs.Length && Width == rhs.Width && MaxLines == rhs.MaxLines && Wrap == rhs.Wrap;
+  }
+
+  // Mixes the fields of a key together.
+  size_t TextCache::KeyHash::operator()(const Key &key) const
+  {
+    size_t hash = std::hash<const void *>()(key.Text);
+    hash ^= std::hash<size_t>()(key.Length) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<unsigned int>()(key.Width * 31u + key.MaxLines * 7u + static_cast<unsigned int>(key.Wrap)) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+  }
+}
+
+#endif
@@ -0,0 +1,868 @@
+#pragma once
+#ifndef WIDGETS_HPP
+#define WIDGETS_HPP
+
+// Includes
+#include <vector>           // Children, list items
+#include <algorithm>        // Clipping
+#include "Text.hpp"
+
+
+// Retained widgets. A widget tree keeps what its widgets last drew in a surface of its own and
+// only has widgets that changed draw again, so a screen that is mostly static costs a blit of
+// the surface per frame plus whatever changed, instead of redrawing every widget.
+namespace RConsole
+{
+  class WidgetTree;
+
+  // What a widget draws with. Coordinates are relative to the widget's top left, and everything
+  // is clipped to the part of the widget that is on the surface.
+  class WidgetPainter
+  {
+  public:
+    // Constructor
+    WidgetPainter(Field2D<RasterInfo> &surface, int x, int y, unsigned int width, unsigned int height, const CellRect &clip);
+
+    // Structure Info
+    unsigned int Width() const;
+    unsigned int Height() const;
+
+    // Drawing
+    void Fill(Glyph toWrite, int x, int y, int w, int h, Color color = WHITE);
+    void DrawGlyph(Glyph toWrite, int x, int y, Color color = WHITE);
+    void DrawSpan(const char *text, size_t len, int x, int y, Color color = WHITE);
+    void DrawLayout(const TextLayout &layout, const char *text, int x, int y, TextAlign align = TEXT_ALIGN_LEFT, Color color = WHITE);
+
+  private:
+    // Variables
+    Field2D<RasterInfo> &surface_;
+    int x_;
+    int y_;
+    unsigned int width_;
+    unsigned int height_;
+    CellRect clip_;
+  };
+
+  // A node in a widget tree, placed relative to its parent's top left. Children are drawn after
+  // their parent and clipped to it. Widgets don't own their children, and destroying either one
+  // unlinks it from the other. Anything that changes how a widget looks should call Invalidate.
+  class Widget
+  {
+  public:
+    // Constructor
+    Widget();
+    virtual ~Widget();
+
+    // Tree
+    void Add(Widget *child);
+    void Remove(Widget *child);
+    Widget *Parent() const;
+    const std::vector<Widget *> &Children() const;
+
+    // Layout
+    void SetRect(int x, int y, unsigned int width, unsigned int height);
+    int X() const;
+    int Y() const;
+    unsigned int Width() const;
+    unsigned int Height() const;
+    void SetVisible(bool visible);
+    bool IsVisible() const;
+
+    // Invalidation
+    void Invalidate();
+    bool IsDirty() const;
+
+  protected:
+    // Draws the whole widget, and has to write every cell of it. A widget is drawn again on its
+    // own, without what's under it, so any cell it leaves alone keeps what it last showed there.
+    virtual void Render(WidgetPainter &painter) = 0;
+
+  private:
+    friend WidgetTree;
+
+    // Hidden Constructors
+    Widget(const Widget &rhs);
+    Widget &operator=(const Widget &rhs);
+
+    // Private methods.
+    void invalidateArea();
+
+    // Variables
+    Widget *parent_;
+    std::vector<Widget *> children_;
+    int x_;
+    int y_;
+    unsigned int width_;
+    unsigned int height_;
+    bool visible_;
+    bool dirty_;
+    bool childDirty_;
+  };
+
+  // Fills its rectangle with one cell. Good for backgrounds and grouping other widgets.
+  class Panel : public Widget
+  {
+  public:
+    Panel(const RasterInfo &background = RasterInfo(' ', WHITE));
+    void SetBackground(const RasterInfo &background);
+
+  protected:
+    void Render(WidgetPainter &painter);
+
+  private:
+    RasterInfo background_;
+  };
+
+  // Text, wrapped and aligned within the label. What doesn't fit is cut off with an ellipsis.
+  class Label : public Widget
+  {
+  public:
+    Label(const std::string &text = std::string(), Color color = WHITE, TextAlign align = TEXT_ALIGN_LEFT, TextWrap wrap = TEXT_WRAP_NONE);
+    void SetText(const std::string &text);
+    void SetColor(Color color);
+    void SetAlign(TextAlign align);
+    const std::string &Text() const;
+
+  protected:
+    void Render(WidgetPainter &painter);
+
+  private:
+    std::string text_;
+    Color color_;
+    TextAlign align_;
+    TextWrap wrap_;
+    TextLayout layout_;
+    bool laidOut_;
+    unsigned int layoutWidth_;
+    unsigned int layoutHeight_;
+  };
+
+  // A single line border with an optional title in the top edge. Children are placed relative
+  // to the top left corner of the border, so the inside starts at 1, 1.
+  class Box : public Widget
+  {
+  public:
+    Box(const std::string &title = std::string(), Color color = WHITE);
+    void SetTitle(const std::string &title);
+    void SetColor(Color color);
+
+  protected:
+    void Render(WidgetPainter &painter);
+
+  private:
+    std::string title_;
+    Color color_;
+  };
+
+  // A horizontal bar filled to a value from 0 to 1, with the percentage over it. Setting a value
+  // that looks the same as the last one doesn't invalidate it.
+  class Gauge : public Widget
+  {
+  public:
+    Gauge(Color color = GREEN, bool showPercent = true);
+    void SetValue(float value);
+    float Value() const;
+
+  protected:
+    void Render(WidgetPainter &painter);
+
+  private:
+    unsigned int filledCells(float value) const;
+
+    float value_;
+    Color color_;
+    bool showPercent_;
+  };
+
+  // Lines of text, one per row, with one selected. The list scrolls to keep the selection shown.
+  class List : public Widget
+  {
+  public:
+    List(Color color = WHITE, Color selectedColor = YELLOW);
+    void SetItems(const std::vector<std::string> &items);
+    void SetSelected(size_t index);
+    size_t Selected() const;
+    const std::vector<std::string> &Items() const;
+
+  protected:
+    void Render(WidgetPainter &painter);
+
+  private:
+    std::vector<std::string> items_;
+    size_t selected_;
+    size_t scroll_;
+    Color color_;
+    Color selectedColor_;
+  };
+
+  // The root of a tree of widgets and the surface they draw into. Draw has the widgets that were
+  // invalidated draw again, along with anything drawn over them, then blits the surface onto the
+  // canvas. When nothing was invalidated, only the blit is left.
+  class WidgetTree
+  {
+  public:
+    // Constructor
+    WidgetTree(unsigned int width, unsigned int height, const RasterInfo &background = RasterInfo(' ', WHITE));
+
+    // Tree
+    Panel &Root();
+    void Resize(unsigned int width, unsigned int height);
+
+    // Drawing
+    void Draw(Canvas &canvas, int x = 0, int y = 0);
+    Field2DView<const RasterInfo> Surface() const;
+    size_t Redrawn() const;
+
+  private:
+    // Hidden Constructors
+    WidgetTree(const WidgetTree &rhs);
+    WidgetTree &operator=(const WidgetTree &rhs);
+
+    // Private methods.
+    CellRect refresh(Widget &widget, int originX, int originY, const CellRect &clip, bool forced);
+    static CellRect intersect(const CellRect &clip, int x, int y, unsigned int width, unsigned int height);
+    static bool overlaps(const CellRect &a, const CellRect &b);
+    static CellRect join(const CellRect &a, const CellRect &b);
+
+    // Variables
+    Field2D<RasterInfo> surface_;
+    Panel root_;
+    size_t redrawn_;
+  };
+}
+
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ // Implementation //////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+namespace RConsole
+{
+  ////////////////////
+ // Widget painter //
+////////////////////
+// Constructor, paints a width by height widget at x, y on the surface, inside clip.
+  WidgetPainter::WidgetPainter(Field2D<RasterInfo> &surface, int x, int y, unsigned int width, unsigned int height, const CellRect &clip)
+    : surface_(surface)
+    , x_(x)
+    , y_(y)
+    , width_(width)
+    , height_(height)
+    , clip_(clip)
+  {  }
+
+  // Width of the widget.
+  unsigned int WidgetPainter::Width() const
+  {
+    return width_;
+  }
+
+  // Height of the widget.
+  unsigned int WidgetPainter::Height() const
+  {
+    return height_;
+  }
+
+  // Fills a rectangle of the widget with one glyph.
+  void WidgetPainter::Fill(Glyph toWrite, int x, int y, int w, int h, Color color)
+  {
+    if (w <= 0 || h <= 0) return;
+
+    // Clip to what the painter may touch.
+    const long long left = std::max<long long>(static_cast<long long>(x_) + x, clip_.X);
+    const long long top = std::max<long long>(static_cast<long long>(y_) + y, clip_.Y);
+    const long long right = std::min<long long>(static_cast<long long>(x_) + x + w, static_cast<long long>(clip_.X) + clip_.Width);
+    const long long bottom = std::min<long long>(static_cast<long long>(y_) + y + h, static_cast<long long>(clip_.Y) + clip_.Height);
+    if (left >= right || top >= bottom) return;
+
+    surface_.FillRect(static_cast<unsigned int>(left), static_cast<unsigned int>(top),
+      static_cast<unsigned int>(right - left), static_cast<unsigned int>(bottom - top), RasterInfo(toWrite, color));
+  }
+
+  // Draws one glyph.
+  void WidgetPainter::DrawGlyph(Glyph toWrite, int x, int y, Color color)
+  {
+    Fill(toWrite, x, y, 1, 1, color);
+  }
+
+  // Draws len bytes of UTF-8 along row y, clipped on both sides. Wide glyphs cut in half by the
+  // clip leave a space in the half that shows.
+  void WidgetPainter::DrawSpan(const char *text, size_t len, int x, int y, Color color)
+  {
+    const long long row = static_cast<long long>(y_) + y;
+    if (row < clip_.Y || row >= static_cast<long long>(clip_.Y) + clip_.Height)
+      return;
+
+    const long long left = clip_.X;
+    const long long right = static_cast<long long>(clip_.X) + clip_.Width;
+    RasterInfo *cells = surface_.Row(static_cast<unsigned int>(row));
+    long long column = static_cast<long long>(x_) + x;
+    size_t read = 0;
+    while (read < len && column < right)
+    {
+      Glyph glyph = GLYPH_EMPTY;
+      read += DecodeGlyph(text + read, len - read, glyph);
+      const unsigned int width = GlyphWidth(glyph);
+      const bool whole = column >= left && column + width <= right;
+      for (unsigned int i = 0; i < width; ++i)
+        if (column + i >= left && column + i < right)
+          cells[column + i] = whole ? RasterInfo(i == 0 ? glyph : GLYPH_WIDE_TAIL, color) : RasterInfo(' ', color);
+      column += width;
+    }
+  }
+
+  // Draws laid out text with its top left at x, y.
+  void WidgetPainter::DrawLayout(const TextLayout &layout, const char *text, int x, int y, TextAlign align, Color color)
+  {
+    const std::vector<TextLine> &lines = layout.Lines();
+    const long long room = static_cast<long long>(width_) - x;
+    const unsigned int box = room > 0 ? static_cast<unsigned int>(room) : 0;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+      const TextLine &line = lines[i];
+      const unsigned int cells = line.Width + (line.Ellipsis ? 1 : 0);
+      int left = x;
+      if (cells < box && align == TEXT_ALIGN_CENTER)
+        left += static_cast<int>((box - cells) / 2);
+      else if (cells < box && align == TEXT_ALIGN_RIGHT)
+        left += static_cast<int>(box - cells);
+
+      const int row = y + static_cast<int>(i);
+      DrawSpan(text + line.Offset, line.Length, left, row, color);
+      if (line.Ellipsis)
+        DrawGlyph(GLYPH_ELLIPSIS, left + static_cast<int>(line.Width), row, color);
+    }
+  }
+
+  ////////////
+ // Widget //
+////////////
+// Constructor, an empty widget that needs drawing.
+  Widget::Widget()
+    : parent_(nullptr)
+    , children_()
+    , x_(0)
+    , y_(0)
+    , width_(0)
+    , height_(0)
+    , visible_(true)
+    , dirty_(true)
+    , childDirty_(false)
+  {  }
+
+  // Leaves the tree, and lets go of any children.
+  Widget::~Widget()
+  {
+    if (parent_ != nullptr)
+      parent_->Remove(this);
+    for (size_t i = 0; i < children_.size(); ++i)
+      children_[i]->parent_ = nullptr;
+  }
+
+  // Adds a child, drawn after (over) the children already there. A child can only have one
+  // parent, so it is taken from any it already has.
+  void Widget::Add(Widget *child)
+  {
+    if (child->parent_ != nullptr)
+      child->parent_->Remove(child);
+    child->parent_ = this;
+    children_.push_back(child);
+    child->Invalidate();
+  }
+
+  // Takes a child out. What it covered is drawn again.
+  void Widget::Remove(Widget *child)
+  {
+    auto found = std::find(children_.begin(), children_.end(), child);
+    if (found == children_.end())
+      return;
+    children_.erase(found);
+    child->parent_ = nullptr;
+    Invalidate();
+  }
+
+  // The widget this one is in, if any.
+  Widget *Widget::Parent() const
+  {
+    return parent_;
+  }
+
+  // The widgets in this one, in the order they are drawn.
+  const std::vector<Widget *> &Widget::Children() const
+  {
+    return children_;
+  }
+
+  // Places the widget relative to its parent's top left.
+  void Widget::SetRect(int x, int y, unsigned int width, unsigned int height)
+  {
+    if (x == x_ && y == y_ && width == width_ && height == height_)
+      return;
+    invalidateArea();
+    x_ = x;
+    y_ = y;
+    width_ = width;
+    height_ = height;
+    Invalidate();
+  }
+
+  // Position relative to the parent.
+  int Widget::X() const
+  {
+    return x_;
+  }
+
+  // Position relative to the parent.
+  int Widget::Y() const
+  {
+    return y_;
+  }
+
+  // Width in cells.
+  unsigned int Widget::Width() const
+  {
+    return width_;
+  }
+
+  // Height in cells.
+  unsigned int Widget::Height() const
+  {
+    return height_;
+  }
+
+  // Shows or hides the widget, along with its children.
+  void Widget::SetVisible(bool visible)
+  {
+    if (visible == visible_)
+      return;
+    visible_ = visible;
+    invalidateArea();
+    Invalidate();
+  }
+
+  // Whether the widget is shown.
+  bool Widget::IsVisible() const
+  {
+    return visible_;
+  }
+
+  // Marks the widget to be drawn again at the next WidgetTree::Draw. Its ancestors are marked as
+  // having something under them to draw, so clean parts of the tree are skipped without a look.
+  void Widget::Invalidate()
+  {
+    dirty_ = true;
+    for (Widget *parent = parent_; parent != nullptr && !parent->childDirty_; parent = parent->parent_)
+      parent->childDirty_ = true;
+  }
+
+  // Whether the widget will be drawn again at the next WidgetTree::Draw.
+  bool Widget::IsDirty() const
+  {
+    return dirty_;
+  }
+
+  // What the widget covers is about to be uncovered, so whatever is under it has to be drawn.
+  void Widget::invalidateArea()
+  {
+    if (parent_ != nullptr)
+      parent_->Invalidate();
+  }
+
+  ///////////
+ // Panel //
+///////////
+// Constructor, fills with background.
+  Panel::Panel(const RasterInfo &background)
+    : background_(background)
+  {  }
+
+  // Changes what the panel is filled with.
+  void Panel::SetBackground(const RasterInfo &background)
+  {
+    if (background == background_)
+      return;
+    background_ = background;
+    Invalidate();
+  }
+
+  // Fills the whole panel.
+  void Panel::Render(WidgetPainter &painter)
+  {
+    painter.Fill(background_.Value, 0, 0, static_cast<int>(painter.Width()), static_cast<int>(painter.Height()), background_.C);
+  }
+
+  ///////////
+ // Label //
+///////////
+// Constructor, the text is laid out when first drawn.
+  Label::Label(const std::string &text, Color color, TextAlign align, TextWrap wrap)
+    : text_(text)
+    , color_(color)
+    , align_(align)
+    , wrap_(wrap)
+    , layout_()
+    , laidOut_(false)
+    , layoutWidth_(0)
+    , layoutHeight_(0)
+  {  }
+
+  // Changes the text. The same text again is left alone.
+  void Label::SetText(const std::string &text)
+  {
+    if (text == text_)
+      return;
+    text_ = text;
+    laidOut_ = false;
+    Invalidate();
+  }
+
+  // Changes the color of the text.
+  void Label::SetColor(Color color)
+  {
+    if (color == color_)
+      return;
+    color_ = color;
+    Invalidate();
+  }
+
+  // Changes how lines sit in the label.
+  void Label::SetAlign(TextAlign align)
+  {
+    if (align == align_)
+      return;
+    align_ = align;
+    Invalidate();
+  }
+
+  // The text shown.
+  const std::string &Label::Text() const
+  {
+    return text_;
+  }
+
+  // Clears the label and draws its lines. The layout is only redone when the text or size changed.
+  void Label::Render(WidgetPainter &painter)
+  {
+    if (!laidOut_ || layoutWidth_ != painter.Width() || layoutHeight_ != painter.Height())
+    {
+      layout_.Layout(text_.data(), text_.size(), painter.Width(), wrap_, painter.Height());
+      layoutWidth_ = painter.Width();
+      layoutHeight_ = painter.Height();
+      laidOut_ = true;
+    }
+
+    painter.Fill(' ', 0, 0, static_cast<int>(painter.Width()), static_cast<int>(painter.Height()), color_);
+    painter.DrawLayout(layout_, text_.data(), 0, 0, align_, color_);
+  }
+
+  /////////
+ // Box //
+/////////
+// Constructor, a border with title in the top edge if there is one.
+  Box::Box(const std::string &title, Color color)
+    : title_(title)
+    , color_(color)
+  {  }
+
+  // Changes the title.
+  void Box::SetTitle(const std::string &title)
+  {
+    if (title == title_)
+      return;
+    title_ = title;
+    Invalidate();
+  }
+
+  // Changes the color of the border and title.
+  void Box::SetColor(Color color)
+  {
+    if (color == color_)
+      return;
+    color_ = color;
+    Invalidate();
+  }
+
+  // Draws the border and clears the inside. Too small for a border, it's just cleared.
+  void Box::Render(WidgetPainter &painter)
+  {
+    const int w = static_cast<int>(painter.Width());
+    const int h = static_cast<int>(painter.Height());
+    painter.Fill(' ', 0, 0, w, h, color_);
+    if (w < 2 || h < 2)
+      return;
+
+    painter.Fill(0x2500, 1, 0, w - 2, 1, color_);
+    painter.Fill(0x2500, 1, h - 1, w - 2, 1, color_);
+    painter.Fill(0x2502, 0, 1, 1, h - 2, color_);
+    painter.Fill(0x2502, w - 1, 1, 1, h - 2, color_);
+    painter.DrawGlyph(0x250C, 0, 0, color_);
+    painter.DrawGlyph(0x2510, w - 1, 0, color_);
+    painter.DrawGlyph(0x2514, 0, h - 1, color_);
+    painter.DrawGlyph(0x2518, w - 1, h - 1, color_);
+
+    // The title sits between the corners, with a space either side, cut short if it must be.
+    if (!title_.empty() && w > 4)
+    {
+      TextLayout title;
+      title.Layout(title_.data(), title_.size(), static_cast<unsigned int>(w - 4), TEXT_WRAP_NONE, 1);
+      if (!title.Lines().empty())
+      {
+        painter.DrawGlyph(' ', 1, 0, color_);
+        painter.DrawLayout(title, title_.data(), 2, 0, TEXT_ALIGN_LEFT, color_);
+        painter.DrawGlyph(' ', 2 + static_cast<int>(title.Width()), 0, color_);
+      }
+    }
+  }
+
+  ///////////
+ // Gauge //
+///////////
+// Constructor, starts empty.
+  Gauge::Gauge(Color color, bool showPercent)
+    : value_(0)
+    , color_(color)
+    , showPercent_(showPercent)
+  {  }
+
+  // Sets how full the gauge is, clamped to 0 to 1. It's only invalidated if that changes how
+  // many cells are filled or the percentage shown.
+  void Gauge::SetValue(float value)
+  {
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    const bool changed = filledCells(value) != filledCells(value_)
+      || (showPercent_ && static_cast<int>(value * 100) != static_cast<int>(value_ * 100));
+    value_ = value;
+    if (changed)
+      Invalidate();
+  }
+
+  // How full the gauge is.
+  float Gauge::Value() const
+  {
+    return value_;
+  }
+
+  // Draws the filled and empty parts of the bar on every row, then the percentage centered.
+  void Gauge::Render(WidgetPainter &painter)
+  {
+    const int w = static_cast<int>(painter.Width());
+    const int h = static_cast<int>(painter.Height());
+    const int filled = static_cast<int>(filledCells(value_));
+    painter.Fill(GLYPH_BLOCK_FULL, 0, 0, filled, h, color_);
+    painter.Fill(GLYPH_SHADE_LIGHT, filled, 0, w - filled, h, DARKGREY);
+
+    if (showPercent_)
+    {
+      char percent[8];
+      const int len = snprintf(percent, sizeof(percent), "%d%%", static_cast<int>(value_ * 100));
+      painter.DrawSpan(percent, static_cast<size_t>(len), (w - len) / 2, (h - 1) / 2, WHITE);
+    }
+  }
+
+  // How many cells a value fills at the gauge's width.
+  unsigned int Gauge::filledCells(float value) const
+  {
+    return static_cast<unsigned int>(value * Width() + 0.5f);
+  }
+
+  //////////
+ // List //
+//////////
+// Constructor, starts with nothing in it.
+  List::List(Color color, Color selectedColor)
+    : items_()
+    , selected_(0)
+    , scroll_(0)
+    , color_(color)
+    , selectedColor_(selectedColor)
+  {  }
+
+  // Replaces the items. The selection stays where it was if it still can.
+  void List::SetItems(const std::vector<std::string> &items)
+  {
+    if (items == items_)
+      return;
+    items_ = items;
+    if (selected_ >= items_.size())
+      selected_ = items_.empty() ? 0 : items_.size() - 1;
+    SetSelected(selected_);
+    Invalidate();
+  }
+
+  // Selects an item, scrolling to it if it's out of view.
+  void List::SetSelected(size_t index)
+  {
+    if (index >= items_.size())
+      return;
+
+    size_t scroll = scroll_;
+    if (index < scroll)
+      scroll = index;
+    else if (Height() > 0 && index >= scroll + Height())
+      scroll = index - Height() + 1;
+
+    if (index == selected_ && scroll == scroll_)
+      return;
+    selected_ = index;
+    scroll_ = scroll;
+    Invalidate();
+  }
+
+  // The selected item.
+  size_t List::Selected() const
+  {
+    return selected_;
+  }
+
+  // Everything in the list.
+  const std::vector<std::string> &List::Items() const
+  {
+    return items_;
+  }
+
+  // Draws the items in view, with a marker and its own color on the selected one.
+  void List::Render(WidgetPainter &painter)
+  {
+    const int w = static_cast<int>(painter.Width());
+    painter.Fill(' ', 0, 0, w, static_cast<int>(painter.Height()), color_);
+
+    TextLayout line;
+    for (unsigned int row = 0; row < painter.Height() && scroll_ + row < items_.size(); ++row)
+    {
+      const size_t index = scroll_ + row;
+      const std::string &item = items_[index];
+      const Color color = (index == selected_) ? selectedColor_ : color_;
+      if (index == selected_)
+        painter.DrawGlyph('>', 0, static_cast<int>(row), color);
+
+      line.Layout(item.data(), item.size(), (w > 2) ? static_cast<unsigned int>(w - 2) : 1, TEXT_WRAP_NONE, 1);
+      painter.DrawLayout(line, item.data(), 2, static_cast<int>(row), TEXT_ALIGN_LEFT, color);
+    }
+  }
+
+  /////////////////
+ // Widget tree //
+/////////////////
+// Constructor, the root covers the whole surface.
+  WidgetTree::WidgetTree(unsigned int width, unsigned int height, const RasterInfo &background)
+    : surface_(width, height)
+    , root_(background)
+    , redrawn_(0)
+  {
+    root_.SetRect(0, 0, width, height);
+  }
+
+  // The widget everything else goes in.
+  Panel &WidgetTree::Root()
+  {
+    return root_;
+  }
+
+  // Resizes the surface and the root, and has everything drawn again.
+  void WidgetTree::Resize(unsigned int width, unsigned int height)
+  {
+    surface_.Resize(width, height);
+    root_.SetRect(0, 0, width, height);
+    root_.Invalidate();
+  }
+
+  // Draws what was invalidated into the surface, then blits the surface onto the canvas.
+  void WidgetTree::Draw(Canvas &canvas, int x, int y)
+  {
+    redrawn_ = 0;
+    refresh(root_, 0, 0, CellRect(0, 0, surface_.Width(), surface_.Height()), false);
+    canvas.Blit(static_cast<const Field2D<RasterInfo> &>(surface_).View(), x, y);
+  }
+
+  // What the widgets last drew.
+  Field2DView<const RasterInfo> WidgetTree::Surface() const
+  {
+    return surface_.View();
+  }
+
+  // How many widgets the last Draw had draw again.
+  size_t WidgetTree::Redrawn() const
+  {
+    return redrawn_;
+  }
+
+  // Draws a widget if it was invalidated or something under it was drawn (forced), then goes
+  // through its children. A child is also drawn if a sibling before it, or anything in one,
+  // drew over where it is. Returns a rectangle around everything that was drawn.
+  CellRect WidgetTree::refresh(Widget &widget, int originX, int originY, const CellRect &clip, bool forced)
+  {
+    if (!forced && !widget.dirty_ && !widget.childDirty_)
+      return CellRect();
+
+    const bool paint = (forced || widget.dirty_) && widget.visible_;
+    widget.dirty_ = false;
+    widget.childDirty_ = false;
+    if (!widget.visible_)
+      return CellRect();
+
+    const int x = originX + widget.x_;
+    const int y = originY + widget.y_;
+    const CellRect area = intersect(clip, x, y, widget.width_, widget.height_);
+    if (paint && !area.Empty())
+    {
+      WidgetPainter painter(surface_, x, y, widget.width_, widget.height_, area);
+      widget.Render(painter);
+      ++redrawn_;
+    }
+
+    // Children draw over their parent, and later children over earlier ones.
+    CellRect drawn = paint ? area : CellRect();
+    std::vector<CellRect> painted;
+    for (size_t i = 0; i < widget.children_.size(); ++i)
+    {
+      Widget &child = *widget.children_[i];
+      const CellRect childArea = intersect(area, x + child.x_, y + child.y_, child.width_, child.height_);
+      bool childForced = paint;
+      for (size_t j = 0; j < painted.size() && !childForced; ++j)
+        childForced = overlaps(painted[j], childArea);
+
+      const CellRect childDrawn = refresh(child, x, y, area, childForced);
+      if (!paint && !childDrawn.Empty())
+      {
+        painted.push_back(childDrawn);
+        drawn = join(drawn, childDrawn);
+      }
+    }
+    return drawn;
+  }
+
+  // The part of a rectangle that is inside clip.
+  CellRect WidgetTree::intersect(const CellRect &clip, int x, int y, unsigned int width, unsigned int height)
+  {
+    const long long left = std::max<long long>(x, clip.X);
+    const long long top = std::max<long long>(y, clip.Y);
+    const long long right = std::min<long long>(static_cast<long long>(x) + width, static_cast<long long>(clip.X) + clip.Width);
+    const long long bottom = std::min<long long>(static_cast<long long>(y) + height, static_cast<long long>(clip.Y) + clip.Height);
+    if (left >= right || top >= bottom)
+      return CellRect();
+    return CellRect(static_cast<unsigned int>(left), static_cast<unsigned int>(top), static_cast<unsigned int>(right - left), static_cast<unsigned int>(bottom - top));
+  }
+
+  // The smallest rectangle around both.
+  CellRect WidgetTree::join(const CellRect &a, const CellRect &b)
+  {
+    if (a.Empty())
+      return b;
+    if (b.Empty())
+      return a;
+    const unsigned int left = std::min(a.X, b.X);
+    const unsigned int top = std::min(a.Y, b.Y);
+    const unsigned int right = std::max(a.X + a.Width, b.X + b.Width);
+    const unsigned int bottom = std::max(a.Y + a.Height, b.Y + b.Height);
+    return CellRect(left, top, right - left, bottom - top);
+  }
+
+  // Whether two rectangles share any cells.
+  bool WidgetTree::overlaps(const CellRect &a, const CellRect &b)
+  {
+    return !a.Empty() && !b.Empty() && a.X < b.X + b.Width && b.X < a.X + a.Width && a.Y < b.Y + b.Height && b.Y < a.Y + a.Height;
+  }
+}
+
+#endif
@@ -136,9 +136,9 @@ int main(int, char**)
     ///////////////////////////////////////////////////////////////////////////////////////
 
     RConsole::_rlutil_internal::setColor(RConsole::_rlutil_internal::MAGENTA);
-    RConsole::_rlutil_internal::locate(RConsole::_rlutil_internal::tcols() - 6, 1);
+    RConsole::_rlutil_internal::locate(RConsole::TerminalSize::Width() - 6, 1);
     printf("ms: %3i", RTest::Timekeeper::GetAvgTimeMS());
-    RConsole::_rlutil_internal::locate(RConsole::_rlutil_internal::tcols() - 5, 2);
+    RConsole::_rlutil_internal::locate(RConsole::TerminalSize::Width() - 5, 2);
     printf("c: %2i", cycles);
   }
   
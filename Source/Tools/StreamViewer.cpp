@@ -0,0 +1,123 @@
+// Attaches to a canvas being streamed by FrameStreamServer and draws it in this terminal.
+//
+//   stream_viewer <socket path>
+//
+// Frames are decoded as they arrive, and whatever arrived together is drawn as one update, so
+// a viewer that falls behind catches up instead of replaying every frame. Ctrl+C detaches, and
+// a stream that sends something other than frames is dropped.
+#include <stdio.h>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include "Recording.hpp"
+
+namespace
+{
+  // Most that can be buffered waiting for the rest of a record, far more than any real frame.
+  const size_t MAX_BUFFERED = 64 << 20;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <socket path>\n", argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+
+  const int stream = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (stream == -1 || connect(stream, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+  {
+    fprintf(stderr, "could not connect to %s\n", argv[1]);
+    return 1;
+  }
+
+  // Sized to the first keyframe. Creating the canvas also sets up the close handler.
+  RConsole::Canvas canvas(1, 1);
+  RConsole::Canvas::SetCursorVisible(false);
+  fputs("\033[2J", stdout);
+
+  RConsole::Field2D<RConsole::RasterInfo> frame(0, 0);
+  std::vector<char> buffer;
+  bool hasHeader = false;
+  const char *ending = "stream ended";
+  char chunk[65536];
+
+  while (true)
+  {
+    // Wait on the stream, and on the close handler so Ctrl+C is noticed right away.
+    struct pollfd fds[2];
+    fds[0].fd = stream;
+    fds[1].fd = RConsole::RConsoleConfig::WakeFd();
+    for (int i = 0; i < 2; ++i)
+    {
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    poll(fds, 2, -1);
+    RConsole::RConsoleConfig::CheckClose();
+    if (!(fds[0].revents & (POLLIN | POLLHUP)))
+      continue;
+
+    const ssize_t got = read(stream, chunk, sizeof(chunk));
+    if (got <= 0)
+      break;
+    buffer.insert(buffer.end(), chunk, chunk + got);
+
+    size_t used = 0;
+    if (!hasHeader)
+    {
+      if (buffer.size() < RConsole::FrameCodec::HeaderSize)
+        continue;
+      if (!RConsole::FrameCodec::CheckHeader(buffer.data(), buffer.size()))
+      {
+        ending = "not a frame stream";
+        break;
+      }
+      hasHeader = true;
+      used = RConsole::FrameCodec::HeaderSize;
+    }
+
+    // Apply every whole record that came in.
+    bool changed = false;
+    uint64_t timeUs = 0;
+    RConsole::FrameKind kind = RConsole::FRAME_DELTA;
+    size_t size = 0;
+    while ((size = RConsole::FrameCodec::Decode(buffer.data() + used, buffer.size() - used, frame, timeUs, kind)) != 0)
+    {
+      if (size == RConsole::FrameCodec::Malformed)
+        break;
+      used += size;
+      changed = true;
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + used);
+
+    // A bad record, or one that claims to be too big to be real, ends the stream.
+    if (size == RConsole::FrameCodec::Malformed || buffer.size() > MAX_BUFFERED)
+    {
+      ending = "bad frame record, detached";
+      break;
+    }
+
+    if (!changed)
+      continue;
+    if (frame.Width() != canvas.GetConsoleWidht() || frame.Height() != canvas.GetConsoleHeight())
+    {
+      fputs("\033[2J", stdout);
+      canvas.ReInit(frame.Width(), frame.Height());
+    }
+    canvas.Blit(frame, 0, 0);
+    canvas.Update();
+  }
+
+  close(stream);
+  RConsole::Canvas::SetCursorVisible(true);
+  printf("\033[0m\033[%u;1H\n%s\n", canvas.GetConsoleHeight(), ending);
+  return 0;
+}